@@ -47,7 +47,9 @@ namespace RBX
 		operator Vector3 *();
 		operator const Vector3 *() const;
 		bool contains(const Vector3& point) const;
+		bool contains(const Extents& other) const;
 		bool overlapsOrTouches(const Extents& other) const;
+		bool overlapsRay(const G3D::Ray& unitRay, float maxDistance) const;
 		bool fuzzyContains(const Vector3& point, float slop) const;
 		bool containedByFrustum(const GCamera::Frustum& frustum) const;
 		bool partiallyContainedByFrustum(const GCamera::Frustum&) const;
@@ -0,0 +1,84 @@
+#pragma once
+#include <new>
+#include <g3d/array.h>
+#include <boost/noncopyable.hpp>
+#include "util/Debug.h"
+
+namespace RBX
+{
+	// Free-list allocator for objects of one type or its subclasses. Storage is carved from slabs of
+	// slabSize slots that go back to the heap only when the pool is destroyed; slotSize must cover
+	// the largest subclass built in the pool, and tInstance needs a virtual destructor if any is.
+	// Build objects with placement new on allocate() and release them with destroy().
+	template <typename tInstance, int slabSize = 256, int slotSize = sizeof(tInstance)>
+	class ObjectPool : public boost::noncopyable
+	{
+	private:
+		union Slot
+		{
+			Slot* next;
+			char storage[slotSize];
+			double align;
+		};
+
+		G3D::Array<Slot*> slabs;
+		Slot* freeList;
+		int numLive;
+		int numAllocations;
+
+	private:
+		void addSlab()
+		{
+			Slot* slab = new Slot[slabSize];
+			for (int i = 0; i < slabSize - 1; i++)
+				slab[i].next = &slab[i + 1];
+			slab[slabSize - 1].next = freeList;
+			freeList = slab;
+			slabs.append(slab);
+		}
+
+	public:
+		ObjectPool()
+			: freeList(NULL),
+			  numLive(0),
+			  numAllocations(0)
+		{
+		}
+
+		~ObjectPool()
+		{
+			RBXASSERT(numLive == 0);
+			for (int i = 0; i < slabs.size(); i++)
+				delete [] slabs[i];
+		}
+
+		void* allocate(size_t size = sizeof(tInstance))
+		{
+			RBXASSERT(size <= slotSize);
+			if (!freeList)
+				addSlab();
+
+			Slot* slot = freeList;
+			freeList = slot->next;
+			numLive++;
+			numAllocations++;
+			return slot->storage;
+		}
+
+		void destroy(tInstance* item)
+		{
+			if (!item)
+				return;
+
+			item->~tInstance();
+			Slot* slot = reinterpret_cast<Slot*>(item);
+			slot->next = freeList;
+			freeList = slot;
+			numLive--;
+		}
+
+		int size() const {return numLive;}
+		int getNumAllocations() const {return numAllocations;}	// lifetime count of allocate() calls
+		int getNumSlabs() const {return slabs.size();}			// heap allocations made for them
+	};
+}
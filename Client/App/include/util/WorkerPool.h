@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+namespace RBX
+{
+	// Fixed set of worker threads that run a batch of tasks to completion.
+	// Each worker owns a queue and pops from its back; idle workers steal from the front of other queues.
+	// The calling thread works on queue 0 while it waits, so a pool of N threads gives N+1 way parallelism.
+	class WorkerPool : public boost::noncopyable
+	{
+	public:
+		class Task
+		{
+		public:
+			virtual ~Task() {}
+			virtual void run() = 0;
+		};
+
+	private:
+		class Queue : public boost::noncopyable
+		{
+		public:
+			boost::mutex mutex;
+			std::deque<Task*> tasks;
+		};
+
+		std::vector<Queue*> queues;
+		boost::thread_group threads;
+		boost::mutex mutex;
+		boost::condition wake;
+		boost::condition done;
+		int generation;
+		bool quit;
+		volatile long pending;
+
+		void workerMain(int slot);
+		Task* pop(int slot);
+		Task* steal(int slot);
+		void drain(int slot);
+
+	public:
+		WorkerPool(int numThreads);
+		~WorkerPool();
+
+		int numThreads() const {return static_cast<int>(queues.size()) - 1;}
+
+		// blocks until every task has run
+		void run(Task* const* tasks, int numTasks);
+	};
+}
@@ -10,6 +10,9 @@
 
 namespace RBX {
 	//class SimBody;
+	class Kernel;
+	class Connector;
+
 	class Body : KernelIndex
 	{
 		private:
@@ -21,12 +24,16 @@ namespace RBX {
 			Cofm *cofm;
 			SimBody *simBody;
 			bool canThrottle;
+			Kernel* throttleKernel;				// kernel of the connectors below, told when canThrottle changes; NULL without any
+			Connector* firstThrottleConnector;	// classified connectors whose canThrottle reads this body
 			RBX::Link *link;
 			CoordinateFrame meInParent;
 			Matrix3 moment;
 			float mass;
 			mutable int stateIndex;
 			mutable PV pv;
+			G3D::Array<Body*> branchOrder;		// root only: every descendant, parents before children
+			bool branchOrderDirty;
 			//int& getKernelIndex();
 			const RBX::SimBody* getRootSimBody() {return getRoot()->simBody;};
 			void resetRoot(RBX::Body* newRoot);
@@ -37,6 +44,8 @@ namespace RBX {
 				return getLink() ? getLink()->getChildInParent() : meInParent;
 			}
 			void updatePV() const;
+			void rebuildBranchOrder();
+			void updateBranchPV();
 			void onChildAdded(RBX::Body* child);
 			void onChildRemoved(RBX::Body* child);
 			const RBX::Body* calcRootConst() const;
@@ -49,7 +58,9 @@ namespace RBX {
 			int& getKernelIndex() {return kernelIndex;}
 			Body();
 			~Body();
-			void step(float, bool);
+			void beginStep(bool throttling);
+			void endStep();
+			SimBody* getSimBody() const {return simBody;}
 			bool cofmIsClean();
 			void makeCofmDirty();
 			void advanceStateIndex();
@@ -131,6 +142,8 @@ namespace RBX {
 				return pv;
 			}
 			const bool getCanThrottle() const {return this->canThrottle;}
+			Kernel*& getThrottleKernel() {return throttleKernel;}
+			Connector*& getFirstThrottleConnector() {return firstThrottleConnector;}
 			void accumulateForceAtCofm(const G3D::Vector3&);
 			void accumulateForceAtBranchCofm(const G3D::Vector3& force)
 			{
@@ -150,6 +163,10 @@ namespace RBX {
 				if (root->simBody)
 					root->simBody->accumulateTorque(torque);
 			}
+			float getInverseMassAlong(const G3D::Vector3& worldPos, const G3D::Vector3& direction) const
+			{
+				return root->simBody ? root->simBody->inverseMassAlong(worldPos, direction) : 0.0f;
+			}
 			void resetAccumulators()
 			{
 				if (root->simBody)
@@ -158,14 +175,14 @@ namespace RBX {
 			const G3D::Vector3& getBranchForce() const
 			{
 				if (root->simBody)
-					return root->simBody->force;
+					return root->simBody->getForce();
 				else
 					return Vector3::zero();
 			}
 			const G3D::Vector3& getBranchTorque() const
 			{
 				if (root->simBody)
-					return root->simBody->torque;
+					return root->simBody->getTorque();
 				else
 					return Vector3::zero();
 			}
@@ -9,23 +9,70 @@
 
 namespace RBX
 {
+	enum ConnectorType
+	{
+		CONTACT_CONNECTOR = 0,
+		POINT_TO_POINT_BREAK_CONNECTOR = 1,
+		NORMAL_BREAK_CONNECTOR = 2,
+		ROTATE_CONNECTOR = 3,
+		OTHER_CONNECTOR = 4
+	};
+
 	class Connector : public RBX::KernelIndex
 	{
+	public:
+		// threads a classified connector onto the list of each body it reads, see Body::getFirstThrottleConnector
+		class BodyLink
+		{
+		public:
+			Body* body;			// NULL while not linked
+			Connector* next;
+			Connector* prev;
+		};
+	private:
+		int throttleIndex;		// index in the kernel's real-time, throttle or unclassified set
+		bool throttleable;		// canThrottle() as of the last time the kernel classified this connector
+		BodyLink bodyLinks[2];
 	public: // this is meant to be private
 		__declspec(noinline) int& getKernelIndex() {return kernelIndex;}
+		int& getThrottleIndex() {return throttleIndex;}
+		bool getThrottleable() const {return throttleable;}
+		void setThrottleable(bool value) {throttleable = value;}
+		BodyLink& getBodyLink(int i) {return bodyLinks[i];}
+		BodyLink& getBodyLink(const Body* body) {return bodyLinks[bodyLinks[0].body == body ? 0 : 1];}
 	public:
 		Connector(const Connector&);
-		Connector() {};
+		Connector() : throttleIndex(-1), throttleable(false)
+		{
+			for (int i = 0; i < 2; i++)
+			{
+				bodyLinks[i].body = NULL;
+				bodyLinks[i].next = NULL;
+				bodyLinks[i].prev = NULL;
+			}
+		}
 		virtual ~Connector() {}
 		virtual void computeForce(const float dt, bool throttling) {}
-		virtual bool canThrottle() {return false;}
+		// Spring force evaluated one step ahead (linearized backward Euler), one spring at a time.
+		// Connectors that are not springs fall back to computeForce.
+		virtual void computeSemiImplicitForce(const float dt, bool throttling) {computeForce(dt, throttling);}
+		virtual bool canThrottle() const {return false;}
 		virtual bool getBroken() {return false;}
 		virtual float potentialEnergy() {return 0;};
+		virtual ConnectorType getConnectorType() const {return OTHER_CONNECTOR;}
+		// spring constant used to pick a stable substep count, 0 if the connector is not a spring
+		virtual float getStiffness() const {return 0;}
+		// bodies and points this connector reads and writes, used to split the kernel into islands
+		virtual int numBodies() const {return 0;}
+		virtual Body* getBody(int i) {return NULL;}
+		virtual int numPoints() const {return 0;}
+		virtual Point* getPoint(int i) {return NULL;}
 		RBX::Connector& operator=(const RBX::Connector&);
 	};
 
 	class ContactConnector : public Connector
 	{
+		friend class ContactBatch;
 	protected:
 		RBX::GeoPair geoPair;
 		float k;
@@ -35,6 +82,8 @@ namespace RBX
 		float threshold;
 		float forceMagLast;
 		G3D::Vector3 frictionOffset;
+	private:
+		void computeForceFromParams(const PairParams& params, const float dt, const float decay, bool semiImplicit);
 	public:
 		ContactConnector(const ContactConnector& other);
 		ContactConnector::ContactConnector(float _k, float _kNeg, float _kFriction)
@@ -57,7 +106,26 @@ namespace RBX
 		void setEdgeEdge(RBX::Body*, RBX::Body*, const G3D::Vector3*, const G3D::Vector3*, RBX::NormalId, RBX::NormalId);
 		bool match(RBX::Body*, RBX::Body*, RBX::GeoPairType, int, int);
 		virtual void computeForce(const float, bool);
+		// non-virtual version of computeForce for batches that all share one pair type, decay from approachDecay(dt)
+		template <GeoPairType pairType>
+		void computeForceOfType(const float dt, const float decay, bool throttling)
+		{
+			RBXASSERT(!throttling || !this->canThrottle());
+
+			PairParams params;
+			this->geoPair.computeLengthNormalPosition<pairType>(params);
+			this->computeForceFromParams(params, dt, decay, false);
+		}
+		virtual void computeSemiImplicitForce(const float dt, bool throttling);
+		void computeSemiImplicitForce(const float dt, const float decay, bool throttling);
+		// per-step decay of firstApproach and threshold, hoisted out of batch loops
+		static float approachDecay(const float dt);
 		virtual bool canThrottle() const;
+		virtual ConnectorType getConnectorType() const {return CONTACT_CONNECTOR;}
+		virtual float getStiffness() const {return k > kNeg ? k : kNeg;}
+		GeoPairType getGeoPairType() const {return geoPair.getGeoPairType();}
+		virtual int numBodies() const {return 2;}
+		virtual Body* getBody(int i) {return geoPair.getBody(i);}
 		virtual ~ContactConnector() {};
 		RBX::ContactConnector& operator=(const RBX::ContactConnector&);
 	};
@@ -72,6 +140,7 @@ namespace RBX
 		bool broken;
 	protected:
 		void forceToPoints(const G3D::Vector3&);
+		G3D::Vector3 semiImplicitForce(const G3D::Vector3& delta, const float dt);
 	public:
 		//PointToPointBreakConnector(const PointToPointBreakConnector&);
 		// TODO:: check if the ctor matches
@@ -84,8 +153,13 @@ namespace RBX
 		{}
 
 		virtual void computeForce(const float dt, bool throttling);
+		virtual void computeSemiImplicitForce(const float dt, bool throttling);
 		virtual bool getBroken() {return this->broken;}
 		virtual float potentialEnergy();
+		virtual ConnectorType getConnectorType() const {return POINT_TO_POINT_BREAK_CONNECTOR;}
+		virtual float getStiffness() const {return k;}
+		virtual int numPoints() const {return 2;}
+		virtual Point* getPoint(int i) {return i == 0 ? point0 : point1;}
 		void setBroken() {this->broken = true;}
 		virtual ~PointToPointBreakConnector() {};
 		//PointToPointBreakConnector& operator=(const PointToPointBreakConnector&);
@@ -106,6 +180,8 @@ namespace RBX
 		virtual ~NormalBreakConnector() {}
 	public:
 		virtual void computeForce(const float dt, bool throttling);
+		virtual void computeSemiImplicitForce(const float dt, bool throttling);
+		virtual ConnectorType getConnectorType() const {return NORMAL_BREAK_CONNECTOR;}
 		//NormalBreakConnector& operator=(const NormalBreakConnector&);
 	};
 
@@ -127,6 +203,18 @@ namespace RBX
 		RotateConnector(Point* base0, Point* ray0, Point* ref0, Point* ref1, float kValue, float armLength);
 		KernelInput* getKernelInput() {return &kernelInput;}
 		virtual void computeForce(const float dt, bool throttling);
+		virtual ConnectorType getConnectorType() const {return ROTATE_CONNECTOR;}
+		virtual int numPoints() const {return 4;}
+		virtual Point* getPoint(int i)
+		{
+			switch (i)
+			{
+			case 0: return base0;
+			case 1: return ray0;
+			case 2: return ref0;
+			default: return ref1;
+			}
+		}
 		virtual ~RotateConnector() {}
 		RBX::RotateConnector& operator=(const RotateConnector& other);
 	};
@@ -0,0 +1,38 @@
+#pragma once
+#include <G3DAll.h>
+#include "v8kernel/Connector.h"
+
+namespace RBX {
+	// Connectors sorted into one pool per concrete type (and per GeoPairType for contacts),
+	// so the kernel can run a tight non-virtual loop per pool instead of a virtual call per connector.
+	// Refilled once per world step: a ContactConnector's pair type is set in place after it enters the kernel.
+	class ConnectorBatches
+	{
+		private:
+			G3D::Array<ContactConnector*> contacts[EDGE_EDGE_PAIR + 1];
+			G3D::Array<PointToPointBreakConnector*> pointToPointBreak;
+			G3D::Array<NormalBreakConnector*> normalBreak;
+			G3D::Array<RotateConnector*> rotate;
+			G3D::Array<Connector*> other;
+		public:
+			void clear();
+			void append(Connector* c);
+
+			// when throttling, connectors the kernel last classified as throttleable are left out
+			template <class Iterable>
+			void fill(const Iterable& connectors, bool throttling)
+			{
+				clear();
+				for (int i = 0; i < connectors.size(); i++)
+				{
+					Connector* c = connectors[i];
+					if (!throttling || !c->getThrottleable())
+						append(c);
+				}
+			}
+
+			void computeForces(float dt, bool throttling);
+			void computeSemiImplicitForces(float dt, bool throttling);
+			int size() const;
+	};
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "v8kernel/Connector.h"
+#include "util/Debug.h"
+
+// SSE intrinsics are available on every x86 target we build for, with or without /arch:SSE.
+// Other targets only get the scalar path.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define RBX_SIMD_CONTACTS
+#endif
+
+namespace RBX {
+	// Geometry results for four contacts, one array per component
+	struct ContactLanes
+	{
+		float positionX[4], positionY[4], positionZ[4];
+		float normalX[4], normalY[4], normalZ[4];
+		float length[4];
+
+		void set(int lane, const PairParams& params)
+		{
+			positionX[lane] = params.position.x;
+			positionY[lane] = params.position.y;
+			positionZ[lane] = params.position.z;
+			normalX[lane] = params.normal.x;
+			normalY[lane] = params.normal.y;
+			normalZ[lane] = params.normal.z;
+			length[lane] = params.length;
+		}
+	};
+
+	// Steps same-type ContactConnectors four at a time with SSE.
+	// POINT_PLANE_PAIR geometry is computed four-wide; other pair types compute geometry per lane and share
+	// the four-wide force path (penetration, normal/perpendicular velocity, friction offset, force).
+	// Leftovers, and builds without SSE, use ContactConnector::computeForceOfType.
+	class ContactBatch
+	{
+		private:
+			static void computePointPlaneLanes(ContactConnector* const* contacts, ContactLanes& lanes);
+			static void computeForceLanes(ContactConnector* const* contacts, const ContactLanes& lanes, float dt, float decay);
+		public:
+			template <GeoPairType pairType>
+			static void computeForces(ContactConnector* const* contacts, int num, float dt, bool throttling)
+			{
+				int i = 0;
+				float decay = ContactConnector::approachDecay(dt);
+#ifdef RBX_SIMD_CONTACTS
+				ContactLanes lanes;
+				for (; i + 4 <= num; i += 4)
+				{
+					for (int j = 0; j < 4; j++)
+					{
+						RBXASSERT(!throttling || !contacts[i + j]->canThrottle());
+						RBXASSERT(contacts[i + j]->getGeoPairType() == pairType);
+					}
+
+					if (pairType == POINT_PLANE_PAIR)
+					{
+						computePointPlaneLanes(contacts + i, lanes);
+					}
+					else
+					{
+						for (int j = 0; j < 4; j++)
+						{
+							PairParams params;
+							contacts[i + j]->geoPair.computeLengthNormalPosition<pairType>(params);
+							lanes.set(j, params);
+						}
+					}
+					computeForceLanes(contacts + i, lanes, dt, decay);
+				}
+#endif
+				for (; i < num; i++)
+				{
+					contacts[i]->computeForceOfType<pairType>(dt, decay, throttling);
+				}
+			}
+	};
+}
@@ -4,6 +4,8 @@
 #include <boost/noncopyable.hpp>
 #include "v8kernel/IStage.h"
 #include "v8kernel/KernelData.h"
+#include "v8kernel/KernelIsland.h"
+#include "util/WorkerPool.h"
 #include "util/Profiling.h"
 
 namespace RBX {
@@ -12,7 +14,26 @@ class Kernel : public IStage {
 		void matchDummy(); //hack, not in original src
 		bool inStepCode;
 		KernelData *kernelData;
-		G3D::Array<RBX::Connector *> realTimeConnectors;
+		boost::scoped_ptr<WorkerPool> workerPool;
+		G3D::Array<KernelIsland*> islands;
+		G3D::Array<WorkerPool::Task*> islandTasks;
+		G3D::Array<KernelIsland*> components;	// adaptive only: one per connected component, packed into islands by substep count
+		G3D::Array<int> componentSubsteps;		// what the current packing was made for
+		int islandTargetCost;
+		bool islandsDirty;
+		bool adaptiveSubsteps;
+		int minSubsteps;
+		int maxSubsteps;
+		bool semiImplicit;
+		bool useIslands() const {return workerPool || adaptiveSubsteps || semiImplicit;}
+		void classifyConnectors();
+		void linkThrottleBodies(Connector* c);
+		void unlinkThrottleBodies(Connector* c);
+		void buildIslands();
+		void packComponents();
+		void clearIslands();
+		void stepIslands(bool throttling);
+		static int minIslandCost() {return 64;}
 		int maxBodies;
 		int maxPoints;
 		int maxConnectors;
@@ -34,6 +55,13 @@ class Kernel : public IStage {
 		void removeConnector2ndPass(RBX::Connector *c);
 		Point* newPoint(Body* _body, const G3D::Vector3& worldPos);
 		void deletePoint(RBX::Point* _point);
+		// pooled and inserted in / removed from the kernel
+		ContactConnector* newContactConnector(float k, float kNeg, float kFriction);
+		void deleteContactConnector(ContactConnector* c);
+		// from Body::setCanThrottle: the connectors that read the body are classified again next throttled step
+		void onCanThrottleChanged(Body* b);
+		const ObjectPool<Point>& getPointPool() const {return kernelData->pointPool;}
+		const ObjectPool<ContactConnector>& getContactConnectorPool() const {return kernelData->contactConnectorPool;}
 		void report(); //inlined or optimized out
 		float connectorSpringEnergy() const;
 		float bodyPotentialEnergy() const; //inlined or optimized out
@@ -42,5 +70,24 @@ class Kernel : public IStage {
 		int numBodies() const;
 		int numPoints() const;
 		int numConnectors() const;
+		// 0 steps the kernel on the calling thread only; otherwise islands are stepped on numThreads workers plus the caller
+		void setNumThreads(int numThreads);
+		int getNumThreads() const;
+		// NULL when single threaded; free for other world stages to use between kernel steps
+		WorkerPool* getWorkerPool() const {return workerPool.get();}
+		int numIslands() const {return islands.size();}
+		// Each island picks between minSubsteps and maxSubsteps per world step from its stiffest
+		// spring, lightest body and fastest body. Off by default: every body gets kernelStepsPerWorldStep.
+		void setAdaptiveSubsteps(bool adaptive, int minSubsteps, int maxSubsteps);
+		bool getAdaptiveSubsteps() const {return adaptiveSubsteps;}
+		int getMinSubsteps() const {return minSubsteps;}
+		int getMaxSubsteps() const {return maxSubsteps;}
+		// Springs are integrated semi-implicitly, which damps stiff joints and contacts and lets
+		// islands without motors choose fewer substeps, see KernelIsland::pickSubsteps. Each substep
+		// costs more, so KernelBenchmark has the trade-off. Off by default.
+		void setSemiImplicit(bool value);
+		bool getSemiImplicit() const {return semiImplicit;}
+		// body-weighted average substep count of the last world step
+		float averageSubsteps() const;
 };
 }
\ No newline at end of file
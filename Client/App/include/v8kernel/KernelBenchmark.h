@@ -0,0 +1,25 @@
+#pragma once
+
+namespace RBX {
+	// Steps a hanging chain of jointed bricks in a private kernel so the explicit and
+	// semi-implicit integrators can be compared on cost and energy drift. Call runSpringChain
+	// once with each setting and the same arguments; substeps pins the count every world step,
+	// 0 leaves it to the kernel.
+	class KernelBenchmark
+	{
+		public:
+			struct Result
+			{
+				int worldSteps;
+				double seconds;				// wall time spent in Kernel::stepWorld
+				float averageSubsteps;
+				float initialEnergy;		// kinetic + spring + gravitational above a floor below the chain
+				float finalEnergy;
+
+				float energyDrift() const {return (finalEnergy - initialEnergy) / initialEnergy;}
+				double secondsPerSimulatedSecond() const;
+			};
+
+			static Result runSpringChain(bool semiImplicit, int numLinks, int worldSteps, int substeps);
+	};
+}
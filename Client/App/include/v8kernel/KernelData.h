@@ -1,8 +1,12 @@
 #pragma once
 #include "v8kernel/Body.h"
+#include "v8kernel/SimBodyArena.h"
 #include "v8kernel/Point.h"
+#include "v8kernel/PointIndex.h"
 #include "v8kernel/Connector.h"
+#include "v8kernel/ConnectorBatches.h"
 #include "util/IndexArray.h"
+#include "util/ObjectPool.h"
 
 namespace RBX {
 	class KernelData
@@ -14,10 +18,26 @@ namespace RBX {
 				RBXASSERT(!bodies.size());
 				RBXASSERT(!connectors.size());
 				RBXASSERT(!connectors2ndPass.size());
+				RBXASSERT(!realTimeConnectors.size());
+				RBXASSERT(!throttleConnectors.size());
+				RBXASSERT(!unclassifiedConnectors.size());
+				RBXASSERT(!simBodies.size());
+				RBXASSERT(!pointPool.size());
+				RBXASSERT(!contactConnectorPool.size());
 			}
 			IndexArray<Body, &Body::getKernelIndex> bodies;
 			IndexArray<Point, &Point::getKernelIndex> points;
+			PointIndex pointIndex;		// same points, hashed on body and local offset
 			IndexArray<Connector, &Connector::getKernelIndex> connectors;
 			IndexArray<Connector, &Connector::getKernelIndex> connectors2ndPass;
+			// connectors partitioned by throttle eligibility; each is in exactly one of these
+			IndexArray<Connector, &Connector::getThrottleIndex> realTimeConnectors;
+			IndexArray<Connector, &Connector::getThrottleIndex> throttleConnectors;
+			IndexArray<Connector, &Connector::getThrottleIndex> unclassifiedConnectors;	// bodies may not be set yet
+			ConnectorBatches connectorBatches;			// refilled from connectors every world step
+			ConnectorBatches connectorBatches2ndPass;
+			SimBodyArena simBodies;	// integration state of bodies, same set as bodies but in arena order
+			ObjectPool<Point> pointPool;
+			ObjectPool<ContactConnector> contactConnectorPool;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+#include <G3DAll.h>
+#include "util/WorkerPool.h"
+#include "v8kernel/ConnectorBatches.h"
+
+namespace RBX {
+	class Body;
+	class Point;
+	class Connector;
+	class SimBodyArena;
+
+	// A group of bodies, points and connectors that share no state with any other island.
+	// Several small islands may be packed into one KernelIsland so each task is worth scheduling.
+	// Lists keep kernel order, so per-body force accumulation order matches the serial kernel.
+	class KernelIsland : public WorkerPool::Task
+	{
+		private:
+			ConnectorBatches connectorBatches;
+			ConnectorBatches connectorBatches2ndPass;
+			int substeps;
+
+			int chooseSubsteps(int low, int high);
+			static float stableOmegaDt() {return 0.15f;}		// KernelBenchmark spring chains hold at 0.15 and fail from 0.24
+			static float semiImplicitOmegaDt() {return 0.45f;}	// KernelBenchmark spring chains hold to 0.5 and fail by 0.6
+			static float maxTravelPerSubstep() {return 0.05f;}	// studs
+			bool hasMotor() const;
+			void computeForces(ConnectorBatches& batches, float dt);
+		public:
+			G3D::Array<Body*> bodies;
+			G3D::Array<int> simBodySlots;
+			G3D::Array<Point*> points;
+			G3D::Array<Connector*> connectors;
+			G3D::Array<Connector*> connectors2ndPass;
+			SimBodyArena* simBodies;
+			bool throttling;
+			bool adaptiveSubsteps;
+			bool semiImplicit;
+			int minSubsteps;
+			int maxSubsteps;
+
+			KernelIsland();
+
+			int cost() const {return bodies.size() + points.size() + connectors.size() + connectors2ndPass.size();}
+			void append(const KernelIsland& other);
+			void clear();
+
+			// substeps this island needs this world step: chosen when adaptive or semi-implicit, else the full count
+			int pickSubsteps();
+			// taken by the next run, and reported by getSubsteps until the one after
+			void setSubsteps(int value) {substeps = value;}
+			int getSubsteps() const {return substeps;}
+
+			// runs every kernel substep of one world step for this island
+			virtual void run();
+	};
+}
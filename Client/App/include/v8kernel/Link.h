@@ -12,9 +12,9 @@ namespace RBX
 			G3D::CoordinateFrame parentCoord;
 			G3D::CoordinateFrame childCoord;
 			G3D::CoordinateFrame childCoordInverse;
-			G3D::CoordinateFrame childInParent;
-			mutable int stateIndex;
-			virtual void computeChildInParent(const G3D::CoordinateFrame& answer) const;
+			mutable G3D::CoordinateFrame childInParent;
+			mutable bool childInParentDirty;	// childInParent depends only on the link's own coords, not on the parent's state
+			virtual void computeChildInParent(G3D::CoordinateFrame& answer) const;
 			void dirty();
 			//void setBody(RBX::Body* _body){ body = _body;}
 		public:
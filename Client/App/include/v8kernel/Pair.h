@@ -37,6 +37,7 @@ namespace RBX
 
 	class GeoPair
 	{
+		friend class ContactBatch;
 	private:
 	struct GeoPairData
 	{
@@ -77,6 +78,10 @@ namespace RBX
 
 		const RBX::Body* getBody(int i) const {return i == 0 ? this->body0 : this->body1;}
 		RBX::Body* getBody(int i) {return i == 0 ? this->body0 : this->body1;}
+		float inverseMassAlong(const G3D::Vector3& normal, const G3D::Vector3& position) const
+		{
+			return body0->getInverseMassAlong(position, normal) + body1->getInverseMassAlong(position, normal);
+		}
 
 		void computeLengthNormalPosition(PairParams& _params)
 		{
@@ -106,6 +111,39 @@ namespace RBX
 			}
 		}
 
+		// same as above when the pair type is known at compile time - the switch folds away
+		template <GeoPairType pairType>
+		void computeLengthNormalPosition(PairParams& _params)
+		{
+			RBXASSERT(this->geoPairType == pairType);
+			switch (pairType)
+			{
+			case BALL_BALL_PAIR:
+				this->computeBallBall(_params);
+				break;
+			case BALL_POINT_PAIR:
+				this->computeBallPoint(_params);
+				break;
+			case BALL_EDGE_PAIR:
+				this->computeBallEdge(_params);
+				break;
+			case BALL_PLANE_PAIR:
+				this->computeBallPlane(_params);
+				break;
+			case POINT_PLANE_PAIR:
+				this->computePointPlane(_params);
+				break;
+			case EDGE_EDGE_PLANE_PAIR:
+				this->computeEdgeEdgePlane(_params);
+				break;
+			case EDGE_EDGE_PAIR:
+				this->computeEdgeEdge(_params);
+				break;
+			}
+		}
+
+		GeoPairType getGeoPairType() const {return this->geoPairType;}
+
 		void computeNormalPerpVel(float& normalVel, G3D::Vector3& perpVel, const PairParams& _params);
 		void forceToBodies(const G3D::Vector3&, const G3D::Vector3&);
 		void setBallBall(Body*, Body*, float, float);
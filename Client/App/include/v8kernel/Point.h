@@ -5,8 +5,11 @@
 namespace RBX {
 	class Point : RBX::KernelIndex
 	{
+		friend class PointIndex;
 	public: // this is meant to be private
 		int numOwners;
+	private:
+		Point* nextInBucket;	// PointIndex chain
 	protected:
 		RBX::Body *body;
 		G3D::Vector3 localPos;
@@ -0,0 +1,29 @@
+#pragma once
+#include <G3DAll.h>
+#include <boost/noncopyable.hpp>
+
+namespace RBX {
+	class Point;
+
+	// Hash set of kernel points keyed on (body, localPos), so Kernel::newPoint can find a
+	// point to share without scanning every point. Chains run through Point::nextInBucket.
+	class PointIndex : public boost::noncopyable
+	{
+		private:
+			G3D::Array<Point*> buckets;
+			int numPoints;
+
+			static size_t hash(const Point* point);
+			int bucketOf(const Point* point) const {return static_cast<int>(hash(point) & (buckets.size() - 1));}
+			void rehash(int numBuckets);
+		public:
+			PointIndex();
+			~PointIndex();
+
+			// returns an indexed point with the same body and local offset as point, or NULL
+			Point* find(const Point* point) const;
+			void insert(Point* point);
+			void remove(Point* point);
+			int size() const {return numPoints;}
+	};
+}
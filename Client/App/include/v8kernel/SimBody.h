@@ -2,6 +2,7 @@
 #include <G3DAll.h>
 #include "util/Quaternion.h"
 #include "util/PV.h"
+#include "v8kernel/SimBodyArena.h"
 //#include "v8kernel/Body.h"
 
 namespace RBX {
@@ -9,39 +10,42 @@ namespace RBX {
 
 	class SimBody
 	{
+		friend class SimBodyArena;
 		private:
+		  SimBodyArena* arena;
+		  int arenaIndex;
 		  void clearAccumulators();
 		  void update();
-		  void updateIfDirty()
-		  {
-			if (dirty)
-				update();
-		  }
+		  G3D::Vector3& force() {return arena->force[arenaIndex];}
+		  G3D::Vector3& torque() {return arena->torque[arenaIndex];}
 		public:
 			Body *body;
 			bool dirty;
-			PV pv;
-			Quaternion qOrientation;
-			G3D::Vector3 angMomentum;
-			G3D::Vector3 momentRecip;
-			float massRecip;
-			float constantForceY;
-			G3D::Vector3 force;
-			G3D::Vector3 torque;
 			//funcs
 			__forceinline void SimBody::unkSimInline(float fNum);
 			//void SimBody(const RBX::SimBody&);
 			SimBody(RBX::Body* body);
 			~SimBody();
 			void step(float dt);
+			void updateIfDirty()
+			{
+				if (dirty)
+					update();
+			}
 			void makeDirty() {dirty = true;};
 			bool getDirty() const {return dirty;};
+			SimBodyArena* getArena() const {return arena;}
+			int getArenaIndex() const {return arenaIndex;}
+			void setFrozen(bool frozen) {arena->frozen[arenaIndex] = frozen;}
+			bool getFrozen() const {return arena->frozen[arenaIndex];}
 			PV getOwnerPV();
-			const PV& getPV() {return pv;}
+			PV getPV() const {return PV(arena->position[arenaIndex], arena->velocity[arenaIndex]);}
 			void accumulateForceCofm(const G3D::Vector3& _force)
 			{
+				if (!arena->accumulates)
+					return;
 				updateIfDirty();
-				force += _force;	
+				force() += _force;	
 			};
 			inline static G3D::Vector3 accumulateInline(const G3D::Vector3& _force, const G3D::Vector3& pvWorld, const G3D::Vector3& worldPos)
 			{
@@ -50,23 +54,29 @@ namespace RBX {
 			}
 			void accumulateForce(const G3D::Vector3& _force, const G3D::Vector3& worldPos)
 			{
+				if (!arena->accumulates)
+					return;
 				updateIfDirty();
-				force += _force;
-				torque += accumulateInline(_force, pv.position.translation, worldPos);
+				force() += _force;
+				torque() += accumulateInline(_force, arena->position[arenaIndex].translation, worldPos);
 			}
 			void accumulateTorque(const G3D::Vector3& _torque)
 			{
+				if (!arena->accumulates)
+					return;
 				updateIfDirty();
-				torque += _torque;	
+				torque() += _torque;	
 			}
 			void SimBody::resetAccumulators()
 			{
 				updateIfDirty();
-				force = Vector3(0.0f, constantForceY, 0.0f);
-				torque = Vector3(0.0f, 0.0f, 0.0f);
+				force() = Vector3(0.0f, arena->constantForceY[arenaIndex], 0.0f);
+				torque() = Vector3(0.0f, 0.0f, 0.0f);
 			}
-			const G3D::Vector3& getForce() const {return force;}
-			const G3D::Vector3& getTorque() const {return torque;}
+			// inverse of the effective mass seen by a force along direction at worldPos; 0 outside a kernel
+			float inverseMassAlong(const G3D::Vector3& worldPos, const G3D::Vector3& direction) const;
+			const G3D::Vector3& getForce() const {return arena->force[arenaIndex];}
+			const G3D::Vector3& getTorque() const {return arena->torque[arenaIndex];}
 			void matchDummy();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#pragma once
+#include <G3DAll.h>
+#include <boost/noncopyable.hpp>
+#include "util/Quaternion.h"
+#include "util/Velocity.h"
+
+namespace RBX {
+	class SimBody;
+
+	// Structure-of-arrays storage for SimBody integration state.
+	// Every SimBody owns exactly one slot in exactly one arena; slot i of every array belongs to owners[i].
+	// Slots are removed by swapping in the last slot, so indices are only stable between insert/remove calls.
+	class SimBodyArena : public boost::noncopyable
+	{
+		private:
+			int appendSlot(SimBody* simBody);
+			void removeSlot(SimBody* simBody);
+			// slots == NULL steps the contiguous range [begin, end), otherwise slots[begin..end)
+			void stepSlots(float dt, const int* slots, int begin, int end);
+		public:
+			G3D::Array<SimBody*> owners;
+			G3D::Array<G3D::CoordinateFrame> position;
+			G3D::Array<Velocity> velocity;
+			G3D::Array<Quaternion> qOrientation;
+			G3D::Array<G3D::Vector3> angMomentum;
+			G3D::Array<G3D::Vector3> momentRecip;
+			G3D::Array<float> massRecip;
+			G3D::Array<float> constantForceY;
+			G3D::Array<G3D::Vector3> force;
+			G3D::Array<G3D::Vector3> torque;
+			G3D::Array<bool> frozen;		// throttled this world step - accumulators are reset but state is not integrated
+
+			const bool accumulates;		// false for the detached arena: forces on bodies outside a kernel are never integrated, so they are dropped
+
+			SimBodyArena(bool _accumulates = true) : accumulates(_accumulates) {}
+			~SimBodyArena() {}
+			int size() const {return owners.size();}
+
+			void insert(SimBody* simBody);
+			void remove(SimBody* simBody);
+			void moveTo(SimBody* simBody, SimBodyArena& destination);
+
+			// integrates slots [begin, end) in a single pass
+			void step(float dt, int begin, int end);
+			void step(float dt) {step(dt, 0, size());}
+			void step(float dt, const int* slots, int numSlots);
+
+			// SimBodies that are not in a kernel live here
+			static SimBodyArena& detached();
+	};
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <G3DAll.h>
+#include "util/Extents.h"
+
+namespace RBX
+{
+	class Primitive;
+
+	// a neighbour query result, ordered nearest first
+	class NearbyPrimitive
+	{
+	public:
+		float distanceSquared;
+		Primitive* primitive;
+
+		bool operator<(const NearbyPrimitive& other) const {return distanceSquared < other.distanceSquared;}
+	};
+
+	// Finds which primitives are close enough to need a Contact. Implementations report pairs to the
+	// ContactManager through onNewPair/onReleasePair and answer the spatial queries it forwards.
+	// Structure and pairs follow each primitive's fat extents; queries test the fuzzy extents.
+	class Broadphase
+	{
+	public:
+		enum BroadphaseType
+		{
+			SPATIAL_HASH_BROADPHASE,
+			AABB_TREE_BROADPHASE,
+			SWEEP_AND_PRUNE_BROADPHASE
+		};
+
+	protected:
+		enum Containment
+		{
+			OUTSIDE,
+			PARTIAL,
+			INSIDE
+		};
+
+		// where box lies against the frustum clipped to bounds
+		static Containment cullExtents(const Extents& box, const GCamera::Frustum& frustum, const Extents& bounds)
+		{
+			if (!box.overlapsOrTouches(bounds) || !box.partiallyContainedByFrustum(frustum))
+				return OUTSIDE;
+			return (bounds.contains(box) && box.containedByFrustum(frustum)) ? INSIDE : PARTIAL;
+		}
+
+	protected:
+		int numFatExtentsKept;			// moving primitives the last onAllPrimitivesMoved left alone
+		int numFatExtentsShrunk;		// moving primitives it rebuilt only because their fat extents had grown loose
+
+	public:
+		Broadphase() : numFatExtentsKept(0), numFatExtentsShrunk(0) {}
+		virtual ~Broadphase() {}
+
+		virtual void onPrimitiveAdded(Primitive* p) = 0;
+		virtual void onPrimitiveRemoved(Primitive* p) = 0;
+		virtual void onPrimitiveExtentsChanged(Primitive* p) = 0;
+		virtual void onAllPrimitivesMoved() = 0;
+
+		// Brings pairs up to date with primitives added or removed since the last step. A broadphase
+		// that batches those does it here as well as before its own steps and queries.
+		virtual void flushChanges() {}
+
+		virtual void getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer) = 0;
+
+		// every primitive whose extents the ray may cross within maxDistance, in no particular order
+		virtual void getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer) = 0;
+
+		// Every primitive whose fuzzy extents are at least partly inside the frustum and bounds, in the
+		// structure's own spatial order. Regions found fully inside are taken whole without per-primitive
+		// tests, so a primitive whose fat extents reach into one may be included too.
+		// A frustum with no faces culls by bounds alone, e.g. for a replication interest box.
+		virtual void getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer) = 0;
+
+		virtual int getNodesOut() const = 0;
+		virtual int getMaxBucket() const {return 0;}
+		virtual int getNumSwaps() const {return 0;}	// sorted-axis swaps made by the last onAllPrimitivesMoved
+		int getNumFatExtentsKept() const {return numFatExtentsKept;}
+		int getNumFatExtentsShrunk() const {return numFatExtentsShrunk;}
+	};
+}
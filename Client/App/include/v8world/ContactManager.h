@@ -4,6 +4,10 @@
 #include <G3DAll.h>
 #include "util/HitTestFilter.h"
 #include "util/Extents.h"
+#include "util/ObjectPool.h"
+#include "util/Debug.h"
+#include "v8world/Contact.h"
+#include "v8world/Broadphase.h"
 
 namespace RBX
 {
@@ -14,29 +18,99 @@ namespace RBX
 
 	class ContactManager
 	{
+	public:
+		// Slots fit every Contact type createContact builds; raise this when a larger one is added.
+		enum {contactSlotSize = sizeof(Contact)};
+		typedef ObjectPool<Contact, 256, contactSlotSize> ContactPool;
+
+	public:
+		// One ray of a getHits batch. worldRay's direction is scaled to the search distance, as in getHit.
+		class RayQuery
+		{
+		public:
+			G3D::Ray worldRay;
+			const G3D::Array<Primitive const*>* ignorePrim;		// may be NULL
+			const HitTestFilter* filter;						// may be NULL
+		};
+
+		class RayHit
+		{
+		public:
+			Primitive* primitive;			// NULL if nothing was hit
+			G3D::Vector3 hitPoint;
+			G3D::Vector3 normal;			// world space, facing out of the primitive
+			bool inside;
+		};
+
 	private:
-		SpatialHash* spatialHash;
+		Broadphase* broadphase;
+		Broadphase::BroadphaseType broadphaseType;
+		SpatialHash* spatialHash;		// NULL unless the broadphase is the hash
 		World* world;
+		ContactPool contactPool;
+		int numNewPairs;			// pair churn since the start of the last stepWorld
+		int numReleasedPairs;
 	private:
 		static bool ignoreBool;
 
 	private:
 		Contact* createContact(Primitive* p0, Primitive* p1);
+		template <class ContactType>
+		Contact* newContact(Primitive* p0, Primitive* p1)
+		{
+			return new (contactPool.allocate(sizeof(ContactType))) ContactType(p0, p1);
+		}
+		Broadphase* newBroadphase(Broadphase::BroadphaseType type);
 		void stepBroadPhase();
 		Primitive* getSlowHit(const G3D::Array<Primitive*>& primitives, const G3D::Ray& unitRay, const G3D::Array<Primitive const*>* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPoint, float maxDistance, bool& inside, bool& stopped) const;
 		Primitive* getFastHit(const G3D::Ray& worldRay, const G3D::Array<Primitive const*>* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPointWorld, bool& inside, bool& stopped) const;
+
+		static int raysPerBundle() {return 16;}
+		static float maxBundleSize() {return 64.0f;}		// longest side of a bundle's box for it to share one query
+		static G3D::Vector3 computeHitNormal(const Primitive* primitive, const G3D::Vector3& hitPoint);
 	public:
 		ContactManager(World* world);
 		~ContactManager();
 	public:
 		const SpatialHash& getSpatialHash()
 		{
+			RBXASSERT(spatialHash);
 			return *spatialHash;
 		}
 
+		const Broadphase& getBroadphase() const
+		{
+			return *broadphase;
+		}
+
+		Broadphase::BroadphaseType getBroadphaseType() const
+		{
+			return broadphaseType;
+		}
+
+		// primitives already in the world move to the new structure; their contacts are rebuilt
+		void setBroadphaseType(Broadphase::BroadphaseType type);
+
 		Primitive* getHit(const G3D::Ray& worldRay, const std::vector<Primitive const*>* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPoint, bool& inside) const;
 		Primitive* getHit(const G3D::Ray& worldRay, const G3D::Array<Primitive const*>* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPoint, bool& inside) const;
+
+		// getHit for many rays at once; hits[i] answers rays[i]. Consecutive rays that stay close
+		// together share their broadphase query, so pass coherent rays next to each other.
+		void getHits(const G3D::Array<RayQuery>& rays, G3D::Array<RayHit>& hits) const;
 		void getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& found);
+
+		// Shape queries against each primitive's fuzzy extents. found must be empty; nothing is allocated
+		// beyond its growth. A filter drops IGNORE_PRIM results - there is no ray for STOP_TEST to stop.
+		// The box and capsule tests are conservative near the edges of the primitive's extents.
+		void getPrimitivesTouchingSphere(const G3D::Vector3& center, float radius, const HitTestFilter* filter, G3D::Array<Primitive*>& found);
+		void getPrimitivesTouchingBox(const G3D::CoordinateFrame& frame, const G3D::Vector3& halfSize, const HitTestFilter* filter, G3D::Array<Primitive*>& found);
+		void getPrimitivesTouchingCapsule(const G3D::Vector3& p0, const G3D::Vector3& p1, float radius, const HitTestFilter* filter, G3D::Array<Primitive*>& found);
+		// frustums are usually open-ended, so bounds limits the search; results keep the broadphase's order
+		void getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, const HitTestFilter* filter, G3D::Array<Primitive*>& found);
+
+		// Up to maxCount primitives whose position is within maxDistance of point, nearest first.
+		// Pass a large maxCount for everything within a radius, sorted.
+		void getNearestPrimitives(const G3D::Vector3& point, float maxDistance, int maxCount, const HitTestFilter* filter, G3D::Array<Primitive*>& found);
 		bool intersectingOthers(Primitive* check, const std::set<Primitive*>& checkSet, float overlapIgnored);
 		bool intersectingOthers(const G3D::Array<Primitive*>& check, float overlapIgnored);
 		bool intersectingOthers(Primitive* check, float overlapIgnored);
@@ -47,6 +121,10 @@ namespace RBX
 		void onPrimitiveExtentsChanged(Primitive* p);
 		void onPrimitiveGeometryTypeChanged(Primitive* p);
 		void stepWorld();
+		void deleteContact(Contact* c);
+		const ContactPool& getContactPool() const {return contactPool;}
+		int getNumNewPairs() const {return numNewPairs;}
+		int getNumReleasedPairs() const {return numReleasedPairs;}
 		RBX::Primitive* getHitLegacy(const G3D::Ray& originDirection, const Primitive* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPointWorld, float& distanceToHit, const float& maxSearchDepth) const;
 	};
 }
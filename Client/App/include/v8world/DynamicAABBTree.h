@@ -0,0 +1,68 @@
+#pragma once
+#include <G3DAll.h>
+#include "v8world/Broadphase.h"
+
+namespace RBX
+{
+	class World;
+	class ContactManager;
+
+	// Broadphase over a bounding volume hierarchy of fat boxes - each leaf holds a primitive's fat
+	// extents, and is only reinserted once the primitive leaves them. Unlike the
+	// grid this doesn't care how sparse the world is or how large a primitive gets.
+	// Two primitives are paired while their fat boxes overlap.
+	class DynamicAABBTree : public Broadphase
+	{
+	private:
+		class Node
+		{
+		public:
+			Extents box;
+			Primitive* primitive;		// NULL for internal nodes
+			int parent;					// next free node while on the free list
+			int child0;
+			int child1;
+			int height;					// 0 for leaves, -1 while free
+
+			bool isLeaf() const {return child0 == -1;}
+		};
+
+		World* world;
+		ContactManager* contactManager;
+		G3D::Array<Node> nodes;
+		int root;
+		int freeList;
+		int nodesOut;
+		G3D::Array<Primitive*> moved;
+		G3D::Array<int> stack;			// traversal scratch
+		G3D::Array<Primitive*> touching;	// findNewPairs scratch
+
+	private:
+		int allocateNode();
+		void freeNode(int index);
+		void insertLeaf(int leaf);
+		void removeLeaf(int leaf);
+		void refitAncestors(int index);
+		int balance(int index);
+		bool refreshLeaf(Primitive* p, bool& shrunk);
+		void releaseSeparatedPairs(Primitive* p);
+		void findNewPairs(Primitive* p);
+		void queryFatBoxes(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer);
+
+		static float surfaceArea(const Extents& box);
+		static Extents combine(const Extents& a, const Extents& b);
+	public:
+		DynamicAABBTree(World* world, ContactManager* contactManager);
+		~DynamicAABBTree();
+
+		virtual void onPrimitiveAdded(Primitive* p);
+		virtual void onPrimitiveRemoved(Primitive* p);
+		virtual void onPrimitiveExtentsChanged(Primitive* p);
+		virtual void onAllPrimitivesMoved();
+		virtual void getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer);
+		virtual void getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer);
+		virtual void getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer);
+		virtual int getNodesOut() const {return nodesOut;}
+		virtual int getMaxBucket() const {return root == -1 ? 0 : nodes[root].height;}
+	};
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+#include <G3DAll.h>
+
+namespace RBX
+{
+	class Primitive;
+	class Edge;
+	class Contact;
+	class Joint;
+
+	// Open-addressing hash from a primitive pair to the Contact and a Joint between them. Kept in step
+	// with the primitives' edge lists so Primitive::getContact and getJoint don't have to walk them.
+	class EdgePairTable
+	{
+	private:
+		class Slot
+		{
+		public:
+			Primitive* p0;			// lower address of the pair, NULL when the slot is empty
+			Primitive* p1;
+			Contact* contact;
+			Joint* joint;			// any one of the pair's joints
+			int numJoints;
+		};
+
+		std::vector<Slot> slots;
+		int numPairs;
+
+	private:
+		int find(const Primitive* p0, const Primitive* p1) const;
+		int findOrAdd(Primitive* p0, Primitive* p1);
+		void removeAt(int index);
+		void resize(size_t newSize);
+
+		static size_t minSlots() {return 256;}
+		static unsigned int hash(const Primitive* p0, const Primitive* p1);
+	public:
+		EdgePairTable();
+
+		void insertEdge(Edge* e);
+		void removeEdge(Edge* e);
+
+		Contact* getContact(const Primitive* p0, const Primitive* p1) const;
+		Joint* getJoint(const Primitive* p0, const Primitive* p1) const;
+		int getNumPairs() const {return numPairs;}
+	};
+}
@@ -14,7 +14,17 @@ namespace RBX
 			NUM_CONTACTSTAGE_CONTACTS,
 			NUM_STEPPING_CONTACTS,
 			NUM_TOUCHING_CONTACTS,
-			MAX_TREE_DEPTH
+			MAX_TREE_DEPTH,
+			NUM_POOLED_CONTACT_CONNECTORS,
+			NUM_POOLED_POINTS,
+			NUM_POOLED_CONTACTS,
+			NUM_POOL_ALLOCATIONS,	// objects handed out by the pools above since the world was created
+			NUM_POOL_SLABS,			// heap allocations the pools made to serve them
+			NUM_BROADPHASE_SWAPS,
+			NUM_BROADPHASE_NEW_PAIRS,
+			NUM_BROADPHASE_RELEASED_PAIRS,
+			NUM_BROADPHASE_FAT_EXTENTS_KEPT,	// moving primitives whose fat extents spared the broadphase any work
+			NUM_BROADPHASE_FAT_EXTENTS_SHRUNK	// moving primitives whose fat extents were rebuilt only to tighten them
 		};
 
 	private:
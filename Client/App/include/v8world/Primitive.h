@@ -21,7 +21,6 @@ namespace RBX
 	class Edge;
 	class Clump;
 	class World;
-	class SpatialNode;
 	class Controller;
 	class Assembly;
 	class IMoving;
@@ -65,12 +64,16 @@ namespace RBX
 		World* world;
 		Clump* clump;
 		int clumpDepth;
-		int traverseId;
-		SpatialNode* spatialNodes;
+		int traverseId;				// last SpatialHash query that listed the primitive
+		int spatialNodes;			// head of the primitive's SpatialHash nodes, -1 when none
 		Vector3int32 oldSpatialMin;
 		Vector3int32 oldSpatialMax;
+		int spatialLevel;			// SpatialHash level the primitive is stored at, -1 when not in the hash
+		int broadphaseIndex;		// owned by the non-hash broadphases, -1 when not in one
+		int movingIndex;			// index in World's moving primitives, -1 when anchored or asleep
 		Extents fuzzyExtents;
 		int fuzzyExtentsStateId;
+		Extents fatExtents;			// what the broadphases see, see updateFatExtents
 	protected:
 		Geometry* geometry;
 		Body* body;
@@ -88,6 +91,9 @@ namespace RBX
 		ComputeProp<float, Primitive> JointK;
 	public:
 		static bool disableSleep;
+		static float fatExtentsMargin;		// studs the fat extents add on every side
+		static float fatExtentsLookahead;	// seconds of linear velocity they reach ahead
+		static float fatExtentsSlack;		// volume over a fresh rebuild at which they are rebuilt anyway
 	private:
 		static bool ignoreBool;
   
@@ -96,6 +102,14 @@ namespace RBX
 		{
 			return worldIndex;
 		}
+		int& broadphaseIndexFunc()
+		{
+			return broadphaseIndex;
+		}
+		int& movingIndexFunc()
+		{
+			return movingIndex;
+		}
 	private:
 		void onChangedInKernel();
 		G3D::Vector3 clipToSafeSize(const G3D::Vector3&);
@@ -211,6 +225,8 @@ namespace RBX
 		Extents getExtentsLocal() const;
 		Extents getExtentsWorld() const;
 		const Extents& getFastFuzzyExtents() const;
+		const Extents& getFatExtents() const {return fatExtents;}
+		bool updateFatExtents(bool& shrunk = ignoreBool);
 		bool hitTest(const G3D::Ray&, G3D::Vector3&, bool&);
 		Face getFaceInObject(NormalId);
 		Face getFaceInWorld(NormalId);
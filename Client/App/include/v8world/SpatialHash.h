@@ -2,6 +2,9 @@
 #include <vector>
 #include "util/Extents.h"
 #include "util/Vector3int32.h"
+#include "v8world/Broadphase.h"
+#include "util/WorkerPool.h"
+#include "util/HitTestFilter.h"
 
 namespace RBX
 {
@@ -9,80 +12,218 @@ namespace RBX
 	class World;
 	class ContactManager;
 
+	// The part of a hash node that bucket walks compare - 24 bytes on a 32 bit build.
+	// Nodes are referred to by index into SpatialHash's slabs, -1 for none.
 	class SpatialNode
 	{
 	public:
-		Primitive* primitive;
-		SpatialNode* nextHashLink;
-		SpatialNode* nextPrimitiveLink;
-		SpatialNode* prevPrimitiveLink;
-		int hashId;
 		Vector3int32 gridId;
+		unsigned char level;
+		bool shadow;				// above the primitive's own level; a primitive that changes level gets new nodes
+		int nextHashLink;			// also links the free list
+		Primitive* primitive;
+	};
 
+	// the rest of a node, only used when a primitive's own nodes are walked
+	class SpatialNodeLinks
+	{
 	public:
-		SpatialNode()
-			: gridId()
-		{
-		}
+		int nextPrimitiveLink;
+		int prevPrimitiveLink;
+		int prevHashLink;			// -1 at the head of its bucket
 	};
 
-	class SpatialHash
+	// Multi-level grid: level 0 cells are 8 studs and each level up is 4x coarser. A primitive is
+	// stored at the finest level whose cells are at least as large as the shortest side of its fat
+	// extents, plus a shadow node in each covering cell of every coarser level, so only occupied cells
+	// have nodes at any level. Shadows hash apart from the nodes stored at their level, so lookups that
+	// skip them never walk them. A pair is two primitives whose fat extents overlap; a primitive finds
+	// its partners among every node in its cells at its own level and the non-shadow nodes in its
+	// covering cells above.
+	class SpatialHash : public Broadphase
 	{
+	public:
+		class Stats
+		{
+		public:
+			enum {MAX_CHAIN_LENGTH = 8};
+
+			int numBuckets;				// both tables while a rehash is under way
+			int numNodes;
+			float loadFactor;			// nodes per bucket
+			int longestChain;
+			int chainLengths[MAX_CHAIN_LENGTH + 1];		// buckets by chain length; the last entry also counts longer ones
+			int numRehashes;
+			bool rehashing;
+		};
+
+		// Walks the level 0 cells a ray passes through in order (Amanatides-Woo): each step crosses
+		// whichever cell boundary the ray reaches first.
+		class RayWalk
+		{
+		private:
+			Vector3int32 grid;
+			int step[3];
+			float nextBoundary[3];		// ray distance to the next boundary on each axis
+			float boundaryDelta[3];		// ray distance between boundaries on each axis
+			float maxDistance;
+		public:
+			RayWalk(const G3D::Ray& unitRay, float maxDistance);
+
+			const Vector3int32& getGrid() const {return grid;}
+
+			// where the ray leaves the current cell
+			float getExitDistance() const
+			{
+				return std::min(nextBoundary[0], std::min(nextBoundary[1], nextBoundary[2]));
+			}
+
+			// false once the next cell starts beyond maxDistance
+			bool next();
+		};
+
 	private:
+		class CellChange
+		{
+		public:
+			Vector3int32 grid;
+			int level;
+			bool add;
+		};
+
+		// one primitive's new cell range, and its cell changes in the owning task's changes array
+		class Move
+		{
+		public:
+			Primitive* primitive;
+			int level;					// reinserted whole when this differs from primitive->spatialLevel
+			Vector3int32 min;
+			Vector3int32 max;
+			int firstChange;
+			int numChanges;
+		};
+
+		// computes the moves for a contiguous range of moving primitives without touching the hash
+		class MoveTask : public WorkerPool::Task
+		{
+		public:
+			const G3D::Array<Primitive*>* primitives;
+			int begin;
+			int end;
+			G3D::Array<Move> moves;
+			G3D::Array<CellChange> changes;
+			int numKept;				// primitives still inside their fat extents
+			int numShrunk;				// primitives whose fat extents were rebuilt to tighten them
+
+			virtual void run();
+		};
+
+		enum {NODE_SLAB_SHIFT = 12, NODE_SLAB_SIZE = 1 << NODE_SLAB_SHIFT};
+
+		// slabs never move, so node references stay good while more slabs are added
+		class NodeSlab
+		{
+		public:
+			SpatialNode nodes[NODE_SLAB_SIZE];
+			SpatialNodeLinks links[NODE_SLAB_SIZE];
+		};
+
 		World* world;
 		ContactManager* contactManager;
-		std::vector<SpatialNode*> nodes;
-		SpatialNode* extraNodes;
+		std::vector<int> buckets;
+		std::vector<int> oldBuckets;	// table being drained into buckets, empty when not rehashing
+		size_t rehashCursor;			// oldBuckets below this have been moved
+		int numRehashes;
+		int traverseStamp;				// bumped by every query, see compactNewPrimitives
+		G3D::Array<NearbyPrimitive> nearby;		// getNearestPrimitives scratch
+		G3D::Array<Primitive*> candidates;		// updatePairs scratch
+		std::vector<NodeSlab*> slabs;
+		std::vector<int> primitivesAtLevel;
+		int freeNodes;
 		int nodesOut;
 		int maxBucket;
+		G3D::Array<MoveTask*> moveTasks;
+		G3D::Array<WorkerPool::Task*> moveTaskPointers;
 	  
 	private:
-		SpatialNode* newNode();
-		void returnNode(SpatialNode*);
-		bool shareCommonGrid(Primitive* me, Primitive* other);
+		SpatialNode& node(int index) {return slabs[index >> NODE_SLAB_SHIFT]->nodes[index & (NODE_SLAB_SIZE - 1)];}
+		const SpatialNode& node(int index) const {return slabs[index >> NODE_SLAB_SHIFT]->nodes[index & (NODE_SLAB_SIZE - 1)];}
+		SpatialNodeLinks& links(int index) {return slabs[index >> NODE_SLAB_SHIFT]->links[index & (NODE_SLAB_SIZE - 1)];}
+		int newNode();
+		void returnNode(int index);
 		bool hashHasPrimitive(Primitive*, int, const Vector3int32&);
-		SpatialNode* findNode(Primitive* p, const Vector3int32& grid);
-		void removeNodeFromHash(SpatialNode* remove);
-		void insertNodeToPrimitive(SpatialNode*, Primitive*, const Vector3int32&, int);
-		void removeNodeFromPrimitive(SpatialNode*);
-		void addNode(Primitive* p, const Vector3int32& grid);
-		void destroyNode(SpatialNode* destroy);
-		void changeMinMax(Primitive* p, const Extents& change, const Extents& oldBox, const Extents& newBox);
+		int findNode(Primitive* p, const Vector3int32& grid, int level);
+		void removeNodeFromHash(int remove);
+		int cellChains(unsigned int hash, int* heads) const;
+		bool isRehashing() const {return !oldBuckets.empty();}
+		void rehashStep(int numOldBuckets);
+		void checkLoad();
+		void insertNodeToPrimitive(int index, Primitive* p);
+		void removeNodeFromPrimitive(int index);
+		void addNode(Primitive* p, const Vector3int32& grid, int level);
+		void addNodes(Primitive* p, int level);
+		void destroyNode(int destroy);
+		void applyMove(const Move& move, const CellChange* changes);
+		void insertPrimitive(Primitive* p, int level);
+		void removePrimitive(Primitive* p);
+		void updatePairs(Primitive* p);
 		void primitiveExtentsChanged(Primitive* p);
+		void getPrimitivesInCell(const Vector3int32& grid, int level, bool shadows, G3D::Array<Primitive*>& found);
+		bool hasShadows(const Vector3int32& grid, int level) const;
+		void compactNewPrimitives(G3D::Array<Primitive*>& answer, int begin, const Extents* extents, const Primitive* ignore);
+		void cullCell(const GCamera::Frustum& frustum, const Extents& bounds, const Vector3int32& grid, int level, G3D::Array<Primitive*>& answer);
+		int gatherNearby(const Vector3int32& grid, const G3D::Vector3& point, float maxDistanceSquared, const HitTestFilter* filter, G3D::Array<Primitive*>& scratch);
 		unsigned int numNodes(unsigned int) const;
 	public:
 		//SpatialHash(const SpatialHash&);
 		SpatialHash(World*, ContactManager*);
 		~SpatialHash();
 	public:
-		void onPrimitiveAdded(Primitive* p);
-		void onPrimitiveRemoved(Primitive* p);
-		void onPrimitiveExtentsChanged(Primitive* p);
-		void onAllPrimitivesMoved();
+		virtual void onPrimitiveAdded(Primitive* p);
+		virtual void onPrimitiveRemoved(Primitive* p);
+		virtual void onPrimitiveExtentsChanged(Primitive* p);
+		virtual void onAllPrimitivesMoved();
 		void getPrimitivesInGrid(const Vector3int32& grid, G3D::Array<Primitive*>& found);
-		bool getNextGrid(Vector3int32&, const G3D::Ray&, float);
-		void getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer);
-		int getNodesOut() const
+		virtual void getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer);
+		virtual void getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer);
+		virtual void getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer);
+		void getNearestPrimitives(const G3D::Vector3& point, float maxDistance, int maxCount, const HitTestFilter* filter, G3D::Array<Primitive*>& answer);
+		virtual int getNodesOut() const
 		{
 			return nodesOut;
 		}
 
-		int getMaxBucket() const
+		virtual int getMaxBucket() const
 		{
 			return maxBucket;
 		}
-		void doStats() const;
+		int getNumBuckets() const {return static_cast<int>(buckets.size() + oldBuckets.size());}
+		void doStats(Stats& stats) const;
 		//SpatialHash& operator=(const SpatialHash&);
 	  
 	private:
 		static float hashGridSize();
 		static float hashGridRecip();
-		static size_t numBuckets();
-		static size_t numBits();
-		static int getHash(const Vector3int32& grid);
+		static size_t minBuckets() {return 0x1000;}
+		static float maxLoadFactor() {return 1.0f;}
+		static float minLoadFactor() {return 0.125f;}
+		static int rehashStepsPerChange() {return 4;}		// old buckets moved by every node added or removed
+		static int rehashStepsPerWorldStep() {return 1024;}	// so a rehash finishes in a quiet world too
+		static int numLevels() {return 4;}
+		static int levelShift() {return 2;}		// log2 of the size ratio between levels
+		static float levelGridSize(int level);
+		static float shortestSide(const Extents& extents);
+		static int computeLevel(const Extents& extents);
+		static int computeLevel(const Extents& extents, int currentLevel);
+		static Vector3int32 toCoarserLevel(const Vector3int32& grid, int levels);
+		static unsigned int getHash(const Vector3int32& grid, int level, bool shadow);
 		static Extents computeMinMax(const Extents&);
-		static void computeMinMax(const Extents& extents, Vector3int32& min, Vector3int32& max);
+		static void computeMinMax(const Extents& extents, int level, Vector3int32& min, Vector3int32& max);
 		static void computeMinMax(const Primitive*, Vector3int32&, Vector3int32&);
+		static void computeMove(Primitive* p, Move& move, G3D::Array<CellChange>& changes);
+		static int minPrimitivesPerTask() {return 256;}
+		static int nearestCellsPerPrimitive() {return 8;}	// ring walk budget before getNearestPrimitives scans instead
+		static int minNearestCells() {return 1024;}
 	public:
 		static Vector3int32 realToHashGrid(const G3D::Vector3& realPoint);
 		static G3D::Vector3 hashGridToReal(const G3D::Vector3&);
@@ -0,0 +1,92 @@
+#pragma once
+#include <G3DAll.h>
+#include "v8world/Broadphase.h"
+
+namespace RBX
+{
+	class World;
+	class ContactManager;
+
+	// Broadphase keeping each primitive's fuzzy extents as min/max endpoints in three sorted axis lists.
+	// A moved primitive's endpoints are insertion-sorted back into place, and each swap with another
+	// primitive's endpoint is the only point where their pair can start or stop - so coherent motion
+	// costs a few swaps instead of re-hashing cells.
+	// Adds and removals are batched until flushChanges: removed endpoints are compacted out in one
+	// pass, added ones sorted, merged in, and paired in one sweep - so loading or clearing a world
+	// is not quadratic.
+	// Queries binary search the x axis and scan the slab from the query's min x, less the widest box's
+	// x width, to its max x - so one very wide box widens every query's slab.
+	class SweepAndPrune : public Broadphase
+	{
+	private:
+		class Endpoint
+		{
+		public:
+			float value;
+			int proxy;
+			bool isMax;
+		};
+
+		class Proxy
+		{
+		public:
+			Primitive* primitive;		// NULL while on the free list
+			Extents box;
+			int endpoint[3][2];			// [axis][isMax] position in axes[axis]
+			int nextFree;
+			int sweepSlot;				// position in flushChanges' active lists
+			bool pending;				// added since the last flushChanges, no endpoints yet
+		};
+
+		World* world;
+		ContactManager* contactManager;
+		G3D::Array<Endpoint> axes[3];
+		G3D::Array<Proxy> proxies;
+		int freeProxy;
+		int numProxies;
+		G3D::Array<int> addedProxies;		// waiting for flushChanges to merge their endpoints in
+		G3D::Array<int> removedProxies;		// primitive cleared, endpoints left for flushChanges to compact
+		G3D::Array<Endpoint> newEndpoints;	// flushChanges scratch
+		G3D::Array<Endpoint> mergedEndpoints;
+		G3D::Array<int> active[2];			// old and added proxies open at a point of the pair sweep
+		int numSwaps;
+		float maxWidth;				// no box is wider on x; exact unless maxWidthDirty
+		int widestProxy;
+		bool maxWidthDirty;			// the widest box shrank or left, recomputed by the next query
+
+	private:
+		int allocateProxy();
+		void setEndpoint(int axis, int index, const Endpoint& endpoint);
+		void swapEndpoints(int axis, int index0, int index1);
+		void sortDown(int axis, int index, bool reportPairs);
+		void sortUp(int axis, int index, bool reportPairs);
+		void onBeginOverlap(int proxy0, int proxy1);
+		void onEndOverlap(int proxy0, int proxy1);
+		void updateProxy(int proxy, const Extents& box);
+		void onWidthChanged(int proxy);
+		void removeDeadEndpoints();
+		void mergeAddedEndpoints();
+		void sweepAddedPairs();
+		static bool valueBelow(const Endpoint& endpoint, float value) {return endpoint.value < value;}
+
+		// a min sorts before a max at the same value, so boxes that only touch count as overlapping
+		static bool endpointBelow(const Endpoint& endpoint0, const Endpoint& endpoint1)
+		{
+			return endpoint0.value < endpoint1.value || (endpoint0.value == endpoint1.value && !endpoint0.isMax && endpoint1.isMax);
+		}
+	public:
+		SweepAndPrune(World* world, ContactManager* contactManager);
+		~SweepAndPrune();
+
+		virtual void onPrimitiveAdded(Primitive* p);
+		virtual void onPrimitiveRemoved(Primitive* p);
+		virtual void onPrimitiveExtentsChanged(Primitive* p);
+		virtual void onAllPrimitivesMoved();
+		virtual void flushChanges();
+		virtual void getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer);
+		virtual void getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer);
+		virtual void getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer);
+		virtual int getNodesOut() const {return 2 * numProxies;}
+		virtual int getNumSwaps() const {return numSwaps;}
+	};
+}
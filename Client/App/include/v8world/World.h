@@ -4,6 +4,7 @@
 #include <G3DAll.h>
 #include "v8world/IWorldStage.h"
 #include "v8world/Primitive.h"
+#include "v8world/EdgePairTable.h"
 #include "util/IndexArray.h"
 #include "util/Events.h"
 #include "util/Profiling.h"
@@ -49,6 +50,8 @@ namespace RBX
 		bool inJointNotification;
 		int worldStepId;
 		RBX::IndexArray<Primitive, &Primitive::worldIndexFunc> primitives;
+		RBX::IndexArray<Primitive, &Primitive::movingIndexFunc> movingPrimitives;
+		EdgePairTable edgePairs;		// every edge in a primitive's edge lists, by pair
 		std::set<Joint*> breakableJoints;
 		int numJoints;
 		int numContacts;
@@ -81,6 +84,7 @@ namespace RBX
 		void addedBodyForce();
 		void setCanThrottle(bool);
 		ContactManager& getContactManager();
+		EdgePairTable& getEdgePairs() {return edgePairs;}
 		ClumpStage* getClumpStage();
 		const CollisionStage* getCollisionStage() const;
 		CollisionStage* getCollisionStage();
@@ -96,6 +100,11 @@ namespace RBX
 		{
 			return this->primitives.underlyingArray();
 		}
+		// primitives of awake, unanchored assemblies - the only ones the broadphase has to update
+		const G3D::Array<Primitive*>& getMovingPrimitives() const
+		{
+			return this->movingPrimitives.underlyingArray();
+		}
 		float step(float);
 		void update();
 		void reset();
@@ -126,6 +135,8 @@ namespace RBX
 		void onPrimitiveRemovingAnchor(Primitive* p);
 		void onPrimitiveExtentsChanged(Primitive* p);
 		void onAssemblyExtentsChanged(Assembly* a);
+		void onAssemblyStartedMoving(Assembly* a);
+		void onAssemblyStoppedMoving(Assembly* a);
 		void onPrimitiveContactParametersChanged(Primitive* p);
 		void onPrimitiveCanCollideChanged(Primitive* p);
 		void onPrimitiveCanSleepChanged(Primitive* p);
@@ -153,6 +153,38 @@ namespace RBX
 		return true;
 	}
 
+	// false only when every corner is outside one plane, so boxes near a frustum edge may pass
+	bool Extents::partiallyContainedByFrustum(const GCamera::Frustum& frustum) const
+	{
+		for (int i = 0; i < frustum.faceArray.size(); i++)
+		{
+			const G3D::Plane& plane = frustum.faceArray[i].plane;
+			bool allOutside = true;
+			for (int j = 0; j < 8 && allOutside; j++)
+			{
+				if (plane.halfSpaceContains(getCorner(j)))
+					allOutside = false;
+			}
+
+			if (allOutside)
+				return false;
+		}
+
+		return true;
+	}
+
+	float Extents::longestSide() const
+	{
+		Vector3 delta = this->high - this->low;
+		return std::max(delta.x, std::max(delta.y, delta.z));
+	}
+
+	float Extents::volume() const
+	{
+		Vector3 delta = this->high - this->low;
+		return delta.x * delta.y * delta.z;
+	}
+
 	bool Extents::contains(const Vector3& point) const
 	{
 		return
@@ -164,6 +196,11 @@ namespace RBX
 			point.z <= this->high.z;
 	}
 
+	bool Extents::contains(const Extents& other) const
+	{
+		return contains(other.low) && contains(other.high);
+	}
+
 	bool Extents::fuzzyContains(const Vector3& point, float slop) const
 	{
 		return
@@ -186,6 +223,39 @@ namespace RBX
 			!(this->high.z < other.low.z);
 	}
 
+	// slab test, clipped to [0, maxDistance] along the ray
+	bool Extents::overlapsRay(const G3D::Ray& unitRay, float maxDistance) const
+	{
+		float tMin = 0.0f;
+		float tMax = maxDistance;
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float origin = unitRay.origin[axis];
+			float direction = unitRay.direction[axis];
+
+			if (fabs(direction) < 1e-9f)
+			{
+				if (origin < this->low[axis] || origin > this->high[axis])
+					return false;
+			}
+			else
+			{
+				float recip = 1.0f / direction;
+				float t0 = (this->low[axis] - origin) * recip;
+				float t1 = (this->high[axis] - origin) * recip;
+				if (t0 > t1)
+					std::swap(t0, t1);
+
+				tMin = std::max(tMin, t0);
+				tMax = std::min(tMax, t1);
+				if (tMin > tMax)
+					return false;
+			}
+		}
+		return true;
+	}
+
 	bool Extents::separatedByMoreThan(const Extents& other, float distance) const
 	{
 		RBXASSERT(distance > 0.0);
@@ -213,6 +283,13 @@ namespace RBX
 		this->high = this->high.max(other.high);
 	}
 
+	void Extents::expand(float distance)
+	{
+		Vector3 dv(distance, distance, distance);
+		this->low -= dv;
+		this->high += dv;
+	}
+
 	Extents Extents::toWorldSpace(const CoordinateFrame& localCoord)
 	{
 		Vector3 minC(Math::inf(), Math::inf(), Math::inf());
@@ -0,0 +1,135 @@
+#include "util/WorkerPool.h"
+#include "util/Debug.h"
+#include <windows.h>
+#include <boost/bind.hpp>
+
+namespace RBX
+{
+	WorkerPool::WorkerPool(int numThreads)
+		: generation(0),
+		  quit(false),
+		  pending(0)
+	{
+		RBXASSERT(numThreads >= 0);
+		for (int i = 0; i <= numThreads; i++)
+		{
+			queues.push_back(new Queue());
+		}
+		for (int i = 1; i <= numThreads; i++)
+		{
+			threads.create_thread(boost::bind(&WorkerPool::workerMain, this, i));
+		}
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			quit = true;
+			wake.notify_all();
+		}
+		threads.join_all();
+
+		for (size_t i = 0; i < queues.size(); i++)
+		{
+			RBXASSERT(queues[i]->tasks.empty());
+			delete queues[i];
+		}
+	}
+
+	void WorkerPool::workerMain(int slot)
+	{
+		int seen = 0;
+		while (true)
+		{
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				while (!quit && generation == seen)
+					wake.wait(lock);
+				if (quit)
+					return;
+				seen = generation;
+			}
+			drain(slot);
+		}
+	}
+
+	WorkerPool::Task* WorkerPool::pop(int slot)
+	{
+		Queue& queue = *queues[slot];
+		boost::mutex::scoped_lock lock(queue.mutex);
+		if (queue.tasks.empty())
+			return NULL;
+
+		Task* task = queue.tasks.back();
+		queue.tasks.pop_back();
+		return task;
+	}
+
+	WorkerPool::Task* WorkerPool::steal(int slot)
+	{
+		int numQueues = static_cast<int>(queues.size());
+		for (int i = 1; i < numQueues; i++)
+		{
+			Queue& victim = *queues[(slot + i) % numQueues];
+			boost::mutex::scoped_lock lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				Task* task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return task;
+			}
+		}
+		return NULL;
+	}
+
+	void WorkerPool::drain(int slot)
+	{
+		while (true)
+		{
+			Task* task = pop(slot);
+			if (!task)
+				task = steal(slot);
+			if (!task)
+				return;
+
+			task->run();
+
+			if (InterlockedDecrement(&pending) == 0)
+			{
+				boost::mutex::scoped_lock lock(mutex);
+				done.notify_all();
+			}
+		}
+	}
+
+	void WorkerPool::run(Task* const* tasks, int numTasks)
+	{
+		if (numTasks == 0)
+			return;
+
+		RBXASSERT(pending == 0);
+		pending = numTasks;
+
+		// deal tasks round robin so every worker starts with local work
+		int numQueues = static_cast<int>(queues.size());
+		for (int i = 0; i < numTasks; i++)
+		{
+			Queue& queue = *queues[i % numQueues];
+			boost::mutex::scoped_lock lock(queue.mutex);
+			queue.tasks.push_back(tasks[i]);
+		}
+
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			generation++;
+			wake.notify_all();
+		}
+
+		drain(0);
+
+		boost::mutex::scoped_lock lock(mutex);
+		while (pending != 0)
+			done.wait(lock);
+	}
+}
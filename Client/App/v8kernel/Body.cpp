@@ -1,11 +1,15 @@
 #include "v8kernel/Body.h"
 #include "v8kernel/SimBody.h"
+#include "v8kernel/Kernel.h"
 #include "util/Debug.h"
+#include <windows.h>
 using namespace RBX;
 
 Body::Body()
 	:index(-1),
 	canThrottle(true),
+	throttleKernel(NULL),
+	firstThrottleConnector(NULL),
 	cofm(NULL),
 	root(NULL),
 	parent(NULL),
@@ -13,7 +17,8 @@ Body::Body()
 	simBody(NULL),
 	stateIndex(getNextStateIndex()),
 	moment(Matrix3::identity()),
-	mass(0.0f)
+	mass(0.0f),
+	branchOrderDirty(false)
 {
 	root = this;
 	simBody = new SimBody(this);
@@ -27,6 +32,7 @@ Body::~Body()
 	RBXASSERT(!parent);
 	RBXASSERT(!link);
 	RBXASSERT(index == -1);
+	RBXASSERT(!firstThrottleConnector);
 	RBXASSERT(simBody);
 	delete simBody;
 	simBody = NULL;
@@ -48,6 +54,42 @@ void Body::updatePV() const
 	}
 }
 
+void Body::rebuildBranchOrder()
+{
+	RBXASSERT(!getParent());
+	branchOrder.fastClear();
+	for (int i = 0; i < numChildren(); i++)
+		branchOrder.append(children[i]);
+
+	// breadth first, so every body comes after its parent
+	for (int i = 0; i < branchOrder.size(); i++)
+	{
+		Body* body = branchOrder[i];
+		for (int j = 0; j < body->numChildren(); j++)
+			branchOrder.append(body->children[j]);
+	}
+	branchOrderDirty = false;
+}
+
+// One linear pass that brings every descendant up to this root's state. Same result as
+// updatePV on each of them, without the recursion up the parent chain.
+void Body::updateBranchPV()
+{
+	RBXASSERT(!getParent());
+	if (branchOrderDirty)
+		rebuildBranchOrder();
+
+	for (int i = 0; i < branchOrder.size(); i++)
+	{
+		Body* body = branchOrder[i];
+		if (body->stateIndex != stateIndex)
+		{
+			body->pv = body->parent->pv.pvAtLocalCoord(body->getMeInParent());
+			body->stateIndex = stateIndex;
+		}
+	}
+}
+
 void Body::resetRoot(RBX::Body* newRoot)
 {
 	RBXASSERT(newRoot == calcRoot());
@@ -65,12 +107,27 @@ float Body::kineticEnergy() const
 
 }
 
+// interlocked so island tasks can advance bodies from several kernel threads at once
 int Body::getNextStateIndex()
 {
-	static int p;
-	if (++p == INT_MAX)
-		p = 1;
-	return p;
+	static volatile LONG p;
+	LONG next = InterlockedIncrement(&p);
+	if (next == INT_MAX)
+	{
+		InterlockedExchange(&p, 1);
+		next = 1;
+	}
+	return next;
+}
+
+void Body::setCanThrottle(bool value)
+{
+	if (canThrottle != value)
+	{
+		canThrottle = value;
+		if (throttleKernel)
+			throttleKernel->onCanThrottleChanged(this);
+	}
 }
 
 void Body::advanceStateIndex()
@@ -156,7 +213,9 @@ void Body::setMass(float _mass)
 	}
 }
 
-void Body::step(float dt, bool throttling)
+// Called once per world step, before the kernel substeps. Throttled bodies keep a slot in the
+// kernel arena but are only reset there, never integrated.
+void Body::beginStep(bool throttling)
 {
 	RBXASSERT(!getParent());
 	RBXASSERT(simBody);
@@ -164,13 +223,26 @@ void Body::step(float dt, bool throttling)
 	if (throttling && canThrottle)
 	{
 		simBody->resetAccumulators();
+		simBody->setFrozen(true);
 	}
 	else
 	{
-		simBody->step(dt);
+		simBody->updateIfDirty();
+		simBody->setFrozen(false);
+	}
+}
 
-		pv = cofm == NULL ? simBody->pv : simBody->getOwnerPV();
+// Called after each batch integration pass over the kernel arena
+void Body::endStep()
+{
+	RBXASSERT(!getParent());
+	RBXASSERT(simBody);
+
+	if (!simBody->getFrozen())
+	{
+		pv = cofm == NULL ? simBody->getPV() : simBody->getOwnerPV();
 		advanceStateIndex();
+		updateBranchPV();
 	}
 }
 
@@ -192,6 +264,7 @@ void Body::setParent(Body* newParent)
 
 	if (parent != newParent)
 	{
+		root->branchOrderDirty = true;
 		if (link)
 		{
 			link->setBody(NULL);
@@ -225,6 +298,9 @@ void Body::setParent(Body* newParent)
 		Body* myRoot = getParent() ? getParent()->calcRoot() : this;
 		myRoot->advanceStateIndex();
 		resetRoot(myRoot);
+		myRoot->branchOrderDirty = true;
+		if (newParent)
+			branchOrder.fastClear();
 	}
 }
 
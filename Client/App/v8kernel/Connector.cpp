@@ -1,4 +1,5 @@
 #include "v8kernel/Connector.h"
+#include "v8kernel/Constants.h"
 #include "util/Debug.h"
 
 namespace RBX
@@ -9,7 +10,34 @@ namespace RBX
 
 		PairParams params;
 		this->geoPair.computeLengthNormalPosition(params);
+		this->computeForceFromParams(params, dt, approachDecay(dt), false);
+	}
+
+	void ContactConnector::computeSemiImplicitForce(const float dt, bool throttling)
+	{
+		this->computeSemiImplicitForce(dt, approachDecay(dt), throttling);
+	}
+
+	void ContactConnector::computeSemiImplicitForce(const float dt, const float decay, bool throttling)
+	{
+		RBXASSERT(!throttling || !this->canThrottle());
+
+		PairParams params;
+		this->geoPair.computeLengthNormalPosition(params);
+		this->computeForceFromParams(params, dt, decay, true);
+	}
 
+	// the 0.999 decay is per kernel step - keep it per second when stepping at another dt
+	float ContactConnector::approachDecay(const float dt)
+	{
+		float decay = 0.999f;
+		if (dt != Constants::kernelDt())
+			decay = powf(decay, dt * Constants::kernelStepsPerSec());
+		return decay;
+	}
+
+	void ContactConnector::computeForceFromParams(const PairParams& params, const float dt, const float decay, bool semiImplicit)
+	{
 		if (params.length < 0.f)
 		{
 			float normalVel;
@@ -32,7 +60,7 @@ namespace RBX
 			float newThreshold;
 			if (this->threshold != 0)
 			{
-				newThreshold = (this->threshold + 0.01f) * 0.999f - 0.01f;
+				newThreshold = (this->threshold + 0.01f) * decay - 0.01f;
 			}
 			else
 			{
@@ -46,7 +74,7 @@ namespace RBX
 			float newFirstApproach;
 			if (this->firstApproach != 0)
 			{
-				newFirstApproach = (this->firstApproach + 0.01f) * 0.999f - 0.01f;
+				newFirstApproach = (this->firstApproach + 0.01f) * decay - 0.01f;
 			}
 			else
 			{
@@ -60,6 +88,24 @@ namespace RBX
 			this->forceMagLast = this->threshold <= params.length ? 0.f : this->forceMagLast;
 
 			Vector3 v31 = this->frictionOffset * v8;
+			if (semiImplicit)
+			{
+				// F = (k * x - dt * k * v) / (1 + dt^2 * k / m) along the normal; the friction spring
+				// is scaled by the effective mass along its own direction
+				float dtSquared = dt * dt;
+				if (this->forceMagLast != 0.f)
+				{
+					float h = dtSquared * this->geoPair.inverseMassAlong(params.normal, params.position);
+					float implicitMag = (this->forceMagLast - dt * kApplied * normalVel) / (1.f + h * kApplied);
+					this->forceMagLast = implicitMag > 0.f ? implicitMag : 0.f;
+				}
+				float frictionMag = this->frictionOffset.magnitude();
+				if (frictionMag > 1e-6f)
+				{
+					float h = dtSquared * this->geoPair.inverseMassAlong(this->frictionOffset / frictionMag, params.position);
+					v31 *= 1.f / (1.f + h * v8);
+				}
+			}
 			Vector3 force = (params.normal * this->forceMagLast) - v31;
 			this->geoPair.forceToBodies(force, params.position); 
 		}
@@ -95,6 +141,54 @@ namespace RBX
 		}
 	}
 
+	// -k * stretch / (1 + dt^2 * k * w) for the part of stretch along one unit direction, where w is
+	// the inverse mass both bodies present along it
+	static Vector3 implicitSpringTerm(const Vector3& stretch, const Vector3& direction, float k, float dt, const Body* body0, const Vector3& pos0, const Body* body1, const Vector3& pos1)
+	{
+		float w = body0->getInverseMassAlong(pos0, direction) + body1->getInverseMassAlong(pos1, direction);
+		return direction * (stretch.dot(direction) * (-k / (1.f + dt * dt * k * w)));
+	}
+
+	// delta is point1 - point0. The stretch a substep ahead is solved along the spring with the
+	// effective mass along it, so the force stays parallel to delta whatever the spring's orientation.
+	// What the relative velocity adds across the spring is solved on its own along that direction.
+	G3D::Vector3 PointToPointBreakConnector::semiImplicitForce(const G3D::Vector3& delta, const float dt)
+	{
+		Body* body0 = this->point0->getBody();
+		Body* body1 = this->point1->getBody();
+		const Vector3& pos0 = this->point0->getWorldPos();
+		const Vector3& pos1 = this->point1->getWorldPos();
+		Vector3 relVel = body1->getPV().linearVelocityAtPoint(pos1) - body0->getPV().linearVelocityAtPoint(pos0);
+		Vector3 stretch = delta + relVel * dt;
+
+		Vector3 force = Vector3::zero();
+		float length = delta.magnitude();
+		if (length > 1e-6f)
+		{
+			Vector3 along = delta / length;
+			force = implicitSpringTerm(stretch, along, this->k, dt, body0, pos0, body1, pos1);
+			stretch -= along * stretch.dot(along);
+		}
+
+		float across = stretch.magnitude();
+		if (across > 1e-6f)
+			force += implicitSpringTerm(stretch, stretch / across, this->k, dt, body0, pos0, body1, pos1);
+		return force;
+	}
+
+	void PointToPointBreakConnector::computeSemiImplicitForce(const float dt, bool throttling)
+	{
+		if (!this->broken)
+		{
+			Vector3 delta = this->point1->getWorldPos() - this->point0->getWorldPos();
+
+			// break on the spring force so joints break at the same loads under either integrator
+			float taxi = Math::taxiCabMagnitude(delta * -this->k);
+			this->broken = taxi > this->breakForce;
+			this->forceToPoints(this->semiImplicitForce(delta, dt));
+		}
+	}
+
 	float PointToPointBreakConnector::potentialEnergy()
 	{
 		Vector3 diff = this->point1->getWorldPos() - this->point0->getWorldPos();
@@ -183,4 +277,17 @@ namespace RBX
 			this->forceToPoints(force);
 		}
 	}
+
+	void NormalBreakConnector::computeSemiImplicitForce(const float dt, bool throttling)
+	{
+		if ( !this->broken )
+		{
+			const Vector3& worldNormal = Math::getWorldNormal(this->normalIdBody0, this->point0->getBody()->getPV().position);
+			Vector3 delta = this->point1->getWorldPos() - this->point0->getWorldPos();
+
+			float forceDot = (delta * -this->k).dot(worldNormal);
+			this->broken = -forceDot > this->breakForce;
+			this->forceToPoints(this->semiImplicitForce(delta, dt));
+		}
+	}
 }
@@ -0,0 +1,125 @@
+#include "v8kernel/ConnectorBatches.h"
+#include "v8kernel/ContactBatch.h"
+#include "util/Debug.h"
+
+namespace RBX {
+
+template <GeoPairType pairType>
+static void computeContactForces(G3D::Array<ContactConnector*>& contacts, float dt, bool throttling)
+{
+	ContactBatch::computeForces<pairType>(contacts.getCArray(), contacts.size(), dt, throttling);
+}
+
+void ConnectorBatches::clear()
+{
+	for (int i = 0; i <= EDGE_EDGE_PAIR; i++)
+	{
+		contacts[i].fastClear();
+	}
+	pointToPointBreak.fastClear();
+	normalBreak.fastClear();
+	rotate.fastClear();
+	other.fastClear();
+}
+
+void ConnectorBatches::append(Connector* c)
+{
+	switch (c->getConnectorType())
+	{
+	case CONTACT_CONNECTOR:
+		{
+			ContactConnector* contact = rbx_static_cast<ContactConnector*>(c);
+			contacts[contact->getGeoPairType()].append(contact);
+		}
+		break;
+	case POINT_TO_POINT_BREAK_CONNECTOR:
+		pointToPointBreak.append(rbx_static_cast<PointToPointBreakConnector*>(c));
+		break;
+	case NORMAL_BREAK_CONNECTOR:
+		normalBreak.append(rbx_static_cast<NormalBreakConnector*>(c));
+		break;
+	case ROTATE_CONNECTOR:
+		rotate.append(rbx_static_cast<RotateConnector*>(c));
+		break;
+	default:
+		other.append(c);
+		break;
+	}
+}
+
+// qualified calls below are resolved at compile time
+void ConnectorBatches::computeForces(float dt, bool throttling)
+{
+	computeContactForces<BALL_BALL_PAIR>(contacts[BALL_BALL_PAIR], dt, throttling);
+	computeContactForces<BALL_POINT_PAIR>(contacts[BALL_POINT_PAIR], dt, throttling);
+	computeContactForces<BALL_EDGE_PAIR>(contacts[BALL_EDGE_PAIR], dt, throttling);
+	computeContactForces<BALL_PLANE_PAIR>(contacts[BALL_PLANE_PAIR], dt, throttling);
+	computeContactForces<POINT_PLANE_PAIR>(contacts[POINT_PLANE_PAIR], dt, throttling);
+	computeContactForces<EDGE_EDGE_PLANE_PAIR>(contacts[EDGE_EDGE_PLANE_PAIR], dt, throttling);
+	computeContactForces<EDGE_EDGE_PAIR>(contacts[EDGE_EDGE_PAIR], dt, throttling);
+
+	for (int i = 0; i < pointToPointBreak.size(); i++)
+	{
+		pointToPointBreak[i]->PointToPointBreakConnector::computeForce(dt, throttling);
+	}
+
+	for (int i = 0; i < normalBreak.size(); i++)
+	{
+		normalBreak[i]->NormalBreakConnector::computeForce(dt, throttling);
+	}
+
+	for (int i = 0; i < rotate.size(); i++)
+	{
+		rotate[i]->RotateConnector::computeForce(dt, throttling);
+	}
+
+	for (int i = 0; i < other.size(); i++)
+	{
+		other[i]->computeForce(dt, throttling);
+	}
+}
+
+// contacts take the scalar path here - the four-wide kernels are explicit only
+void ConnectorBatches::computeSemiImplicitForces(float dt, bool throttling)
+{
+	float decay = ContactConnector::approachDecay(dt);
+	for (int i = 0; i <= EDGE_EDGE_PAIR; i++)
+	{
+		for (int j = 0; j < contacts[i].size(); j++)
+		{
+			contacts[i][j]->computeSemiImplicitForce(dt, decay, throttling);
+		}
+	}
+
+	for (int i = 0; i < pointToPointBreak.size(); i++)
+	{
+		pointToPointBreak[i]->PointToPointBreakConnector::computeSemiImplicitForce(dt, throttling);
+	}
+
+	for (int i = 0; i < normalBreak.size(); i++)
+	{
+		normalBreak[i]->NormalBreakConnector::computeSemiImplicitForce(dt, throttling);
+	}
+
+	for (int i = 0; i < rotate.size(); i++)
+	{
+		rotate[i]->RotateConnector::computeForce(dt, throttling);
+	}
+
+	for (int i = 0; i < other.size(); i++)
+	{
+		other[i]->computeSemiImplicitForce(dt, throttling);
+	}
+}
+
+int ConnectorBatches::size() const
+{
+	int result = pointToPointBreak.size() + normalBreak.size() + rotate.size() + other.size();
+	for (int i = 0; i <= EDGE_EDGE_PAIR; i++)
+	{
+		result += contacts[i].size();
+	}
+	return result;
+}
+
+}
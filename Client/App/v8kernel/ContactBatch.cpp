@@ -0,0 +1,235 @@
+#include "v8kernel/ContactBatch.h"
+#include "util/Math.h"
+
+#ifdef RBX_SIMD_CONTACTS
+#include <xmmintrin.h>
+
+namespace RBX {
+
+// three components of four lanes
+struct Vector3x4
+{
+	__m128 x;
+	__m128 y;
+	__m128 z;
+};
+
+static __forceinline Vector3x4 make3x4(__m128 x, __m128 y, __m128 z)
+{
+	Vector3x4 result;
+	result.x = x;
+	result.y = y;
+	result.z = z;
+	return result;
+}
+
+static __forceinline Vector3x4 gather3x4(const G3D::Vector3& v0, const G3D::Vector3& v1, const G3D::Vector3& v2, const G3D::Vector3& v3)
+{
+	return make3x4(_mm_set_ps(v3.x, v2.x, v1.x, v0.x), _mm_set_ps(v3.y, v2.y, v1.y, v0.y), _mm_set_ps(v3.z, v2.z, v1.z, v0.z));
+}
+
+static __forceinline Vector3x4 add3x4(const Vector3x4& a, const Vector3x4& b)
+{
+	return make3x4(_mm_add_ps(a.x, b.x), _mm_add_ps(a.y, b.y), _mm_add_ps(a.z, b.z));
+}
+
+static __forceinline Vector3x4 sub3x4(const Vector3x4& a, const Vector3x4& b)
+{
+	return make3x4(_mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z));
+}
+
+static __forceinline Vector3x4 mul3x4(const Vector3x4& a, __m128 s)
+{
+	return make3x4(_mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s));
+}
+
+static __forceinline __m128 dot3x4(const Vector3x4& a, const Vector3x4& b)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+}
+
+static __forceinline Vector3x4 cross3x4(const Vector3x4& a, const Vector3x4& b)
+{
+	return make3x4(_mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+				   _mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+				   _mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)));
+}
+
+static __forceinline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// rotation * offset + translation for four frames at once
+static __forceinline Vector3x4 pointToWorldSpace4(const G3D::CoordinateFrame* const* c, const G3D::Vector3* const* offset)
+{
+	Vector3x4 o = gather3x4(*offset[0], *offset[1], *offset[2], *offset[3]);
+	Vector3x4 result = gather3x4(c[0]->translation, c[1]->translation, c[2]->translation, c[3]->translation);
+	for (int row = 0; row < 3; row++)
+	{
+		__m128 r0 = _mm_set_ps(c[3]->rotation[row][0], c[2]->rotation[row][0], c[1]->rotation[row][0], c[0]->rotation[row][0]);
+		__m128 r1 = _mm_set_ps(c[3]->rotation[row][1], c[2]->rotation[row][1], c[1]->rotation[row][1], c[0]->rotation[row][1]);
+		__m128 r2 = _mm_set_ps(c[3]->rotation[row][2], c[2]->rotation[row][2], c[1]->rotation[row][2], c[0]->rotation[row][2]);
+		__m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, o.x), _mm_mul_ps(r1, o.y)), _mm_mul_ps(r2, o.z));
+		__m128& out = (row == 0) ? result.x : ((row == 1) ? result.y : result.z);
+		out = _mm_add_ps(out, value);
+	}
+	return result;
+}
+
+// Four-wide GeoPair::computePointPlane
+void ContactBatch::computePointPlaneLanes(ContactConnector* const* contacts, ContactLanes& lanes)
+{
+	const G3D::CoordinateFrame* c0[4];
+	const G3D::CoordinateFrame* c1[4];
+	const G3D::Vector3* offset0[4];
+	const G3D::Vector3* offset1[4];
+	G3D::Vector3 normal[4];
+
+	for (int j = 0; j < 4; j++)
+	{
+		GeoPair& geoPair = contacts[j]->geoPair;
+		c0[j] = &geoPair.body0->getPV().position;
+		c1[j] = &geoPair.body1->getPV().position;
+		offset0[j] = geoPair.offset0;
+		offset1[j] = geoPair.offset1;
+		normal[j] = -Math::getWorldNormal(geoPair.pairData.normalID1, *c1[j]);
+	}
+
+	Vector3x4 position = pointToWorldSpace4(c0, offset0);
+	Vector3x4 body1WorldSpace = pointToWorldSpace4(c1, offset1);
+	Vector3x4 n = gather3x4(normal[0], normal[1], normal[2], normal[3]);
+
+	_mm_storeu_ps(lanes.positionX, position.x);
+	_mm_storeu_ps(lanes.positionY, position.y);
+	_mm_storeu_ps(lanes.positionZ, position.z);
+	_mm_storeu_ps(lanes.normalX, n.x);
+	_mm_storeu_ps(lanes.normalY, n.y);
+	_mm_storeu_ps(lanes.normalZ, n.z);
+	_mm_storeu_ps(lanes.length, dot3x4(n, sub3x4(body1WorldSpace, position)));
+}
+
+// Four-wide ContactConnector::computeForceFromParams. Branches become masks; results are written
+// back and applied to the bodies in lane order, so accumulation order matches the scalar loop.
+void ContactBatch::computeForceLanes(ContactConnector* const* contacts, const ContactLanes& lanes, float dt, float decay)
+{
+	const __m128 zero = _mm_setzero_ps();
+	__m128 length = _mm_loadu_ps(lanes.length);
+	__m128 penetrating = _mm_cmplt_ps(length, zero);
+	int penetratingBits = _mm_movemask_ps(penetrating);
+
+	if (penetratingBits == 0)
+	{
+		for (int j = 0; j < 4; j++)
+		{
+			contacts[j]->firstApproach = 0;
+			contacts[j]->threshold = 0;
+			contacts[j]->forceMagLast = 0;
+		}
+		return;
+	}
+
+	Vector3x4 position = make3x4(_mm_loadu_ps(lanes.positionX), _mm_loadu_ps(lanes.positionY), _mm_loadu_ps(lanes.positionZ));
+	Vector3x4 normal = make3x4(_mm_loadu_ps(lanes.normalX), _mm_loadu_ps(lanes.normalY), _mm_loadu_ps(lanes.normalZ));
+
+	const PV* pv0[4];
+	const PV* pv1[4];
+	for (int j = 0; j < 4; j++)
+	{
+		pv0[j] = &contacts[j]->geoPair.body0->getPV();
+		pv1[j] = &contacts[j]->geoPair.body1->getPV();
+	}
+
+	// GeoPair::computeNormalPerpVel
+	Vector3x4 t0 = gather3x4(pv0[0]->position.translation, pv0[1]->position.translation, pv0[2]->position.translation, pv0[3]->position.translation);
+	Vector3x4 linear0 = gather3x4(pv0[0]->velocity.linear, pv0[1]->velocity.linear, pv0[2]->velocity.linear, pv0[3]->velocity.linear);
+	Vector3x4 rotational0 = gather3x4(pv0[0]->velocity.rotational, pv0[1]->velocity.rotational, pv0[2]->velocity.rotational, pv0[3]->velocity.rotational);
+	Vector3x4 t1 = gather3x4(pv1[0]->position.translation, pv1[1]->position.translation, pv1[2]->position.translation, pv1[3]->position.translation);
+	Vector3x4 linear1 = gather3x4(pv1[0]->velocity.linear, pv1[1]->velocity.linear, pv1[2]->velocity.linear, pv1[3]->velocity.linear);
+	Vector3x4 rotational1 = gather3x4(pv1[0]->velocity.rotational, pv1[1]->velocity.rotational, pv1[2]->velocity.rotational, pv1[3]->velocity.rotational);
+
+	Vector3x4 velocity0 = add3x4(linear0, cross3x4(rotational0, sub3x4(position, t0)));
+	Vector3x4 velocity1 = add3x4(linear1, cross3x4(rotational1, sub3x4(position, t1)));
+	Vector3x4 deltaVelocity = sub3x4(velocity1, velocity0);
+	__m128 normalVel = dot3x4(normal, deltaVelocity);
+	Vector3x4 perpVel = sub3x4(deltaVelocity, mul3x4(normal, normalVel));
+
+	// connector state
+	ContactConnector* c0 = contacts[0];
+	ContactConnector* c1 = contacts[1];
+	ContactConnector* c2 = contacts[2];
+	ContactConnector* c3 = contacts[3];
+	__m128 k = _mm_set_ps(c3->k, c2->k, c1->k, c0->k);
+	__m128 kNeg = _mm_set_ps(c3->kNeg, c2->kNeg, c1->kNeg, c0->kNeg);
+	__m128 kFriction = _mm_set_ps(c3->kFriction, c2->kFriction, c1->kFriction, c0->kFriction);
+	__m128 firstApproach = _mm_set_ps(c3->firstApproach, c2->firstApproach, c1->firstApproach, c0->firstApproach);
+	__m128 threshold = _mm_set_ps(c3->threshold, c2->threshold, c1->threshold, c0->threshold);
+	__m128 forceMagLast = _mm_set_ps(c3->forceMagLast, c2->forceMagLast, c1->forceMagLast, c0->forceMagLast);
+	Vector3x4 frictionOffset = gather3x4(c0->frictionOffset, c1->frictionOffset, c2->frictionOffset, c3->frictionOffset);
+
+	// friction
+	frictionOffset = add3x4(frictionOffset, mul3x4(perpVel, _mm_set1_ps(dt)));
+	__m128 v8 = _mm_mul_ps(k, _mm_set1_ps(0.2f));
+	__m128 mag = _mm_mul_ps(_mm_sqrt_ps(dot3x4(frictionOffset, frictionOffset)), v8);
+	__m128 v10 = _mm_mul_ps(kFriction, forceMagLast);
+	__m128 clamp = _mm_and_ps(_mm_cmplt_ps(v10, mag), _mm_cmpgt_ps(mag, _mm_set1_ps(0.00000001f)));
+	if (_mm_movemask_ps(clamp) != 0)
+	{
+		// masked-off lanes may divide by zero; their result is discarded
+		frictionOffset = mul3x4(frictionOffset, select4(clamp, _mm_div_ps(v10, mag), _mm_set1_ps(1.0f)));
+	}
+	frictionOffset = sub3x4(frictionOffset, mul3x4(normal, dot3x4(frictionOffset, normal)));
+
+	// approach tracking
+	const __m128 offset = _mm_set1_ps(0.01f);
+	const __m128 decay4 = _mm_set1_ps(decay);
+	__m128 thresholdSet = _mm_cmpneq_ps(threshold, zero);
+	__m128 firstApproachSet = _mm_cmpneq_ps(firstApproach, zero);
+	__m128 decayedThreshold = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(threshold, offset), decay4), offset);
+	__m128 decayedFirstApproach = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(firstApproach, offset), decay4), offset);
+	threshold = select4(thresholdSet, decayedThreshold, _mm_and_ps(firstApproachSet, length));
+	firstApproach = select4(firstApproachSet, decayedFirstApproach, length);
+
+	// normal force
+	__m128 kApplied = select4(_mm_cmplt_ps(perpVel.x, zero), k, kNeg);
+	forceMagLast = _mm_mul_ps(_mm_sub_ps(firstApproach, length), kApplied);
+	forceMagLast = _mm_andnot_ps(_mm_cmple_ps(threshold, length), forceMagLast);
+
+	Vector3x4 force = sub3x4(mul3x4(normal, forceMagLast), mul3x4(frictionOffset, v8));
+
+	float outThreshold[4], outFirstApproach[4], outForceMagLast[4];
+	float outFrictionX[4], outFrictionY[4], outFrictionZ[4];
+	float outForceX[4], outForceY[4], outForceZ[4];
+	_mm_storeu_ps(outThreshold, threshold);
+	_mm_storeu_ps(outFirstApproach, firstApproach);
+	_mm_storeu_ps(outForceMagLast, forceMagLast);
+	_mm_storeu_ps(outFrictionX, frictionOffset.x);
+	_mm_storeu_ps(outFrictionY, frictionOffset.y);
+	_mm_storeu_ps(outFrictionZ, frictionOffset.z);
+	_mm_storeu_ps(outForceX, force.x);
+	_mm_storeu_ps(outForceY, force.y);
+	_mm_storeu_ps(outForceZ, force.z);
+
+	for (int j = 0; j < 4; j++)
+	{
+		ContactConnector* c = contacts[j];
+		if (penetratingBits & (1 << j))
+		{
+			c->frictionOffset = G3D::Vector3(outFrictionX[j], outFrictionY[j], outFrictionZ[j]);
+			c->threshold = outThreshold[j];
+			c->firstApproach = outFirstApproach[j];
+			c->forceMagLast = outForceMagLast[j];
+			c->geoPair.forceToBodies(G3D::Vector3(outForceX[j], outForceY[j], outForceZ[j]), G3D::Vector3(lanes.positionX[j], lanes.positionY[j], lanes.positionZ[j]));
+		}
+		else
+		{
+			c->firstApproach = 0;
+			c->threshold = 0;
+			c->forceMagLast = 0;
+		}
+	}
+}
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "v8kernel/Kernel.h"
+#include <algorithm>
 #include "util/Debug.h"
 #include "v8kernel/Constants.h"
 #include "v8kernel/Connector.h"
@@ -13,62 +14,223 @@ Kernel::Kernel(RBX::IStage* upstream)
 			kernelData(new KernelData()),
 			maxBodies(0),
 			maxPoints(0),
-			maxConnectors(0){numKernels++;}
+			maxConnectors(0),
+			islandTargetCost(0),
+			islandsDirty(true),
+			adaptiveSubsteps(false),
+			minSubsteps(Constants::kernelStepsPerWorldStep()),
+			maxSubsteps(Constants::kernelStepsPerWorldStep()),
+			semiImplicit(false){numKernels++;}
 
 Kernel::~Kernel()
 {
 	Kernel::numKernels--;
 	RBXASSERT(!inStepCode);
+	clearIslands();
 	delete kernelData;
 
 }
 
+void Kernel::setNumThreads(int numThreads)
+{
+	RBXASSERT(!inStepCode);
+	if (numThreads == getNumThreads())
+		return;
+
+	workerPool.reset(numThreads > 0 ? new WorkerPool(numThreads) : NULL);
+	islandsDirty = true;
+}
+
+int Kernel::getNumThreads() const
+{
+	return workerPool ? workerPool->numThreads() : 0;
+}
+
+void Kernel::setAdaptiveSubsteps(bool adaptive, int _minSubsteps, int _maxSubsteps)
+{
+	RBXASSERT(!inStepCode);
+	RBXASSERT(_minSubsteps >= 1 && _minSubsteps <= _maxSubsteps);
+	if (adaptive != adaptiveSubsteps)
+		islandsDirty = true;
+	adaptiveSubsteps = adaptive;
+	minSubsteps = _minSubsteps;
+	maxSubsteps = _maxSubsteps;
+}
+
+void Kernel::setSemiImplicit(bool value)
+{
+	RBXASSERT(!inStepCode);
+	semiImplicit = value;
+}
+
+float Kernel::averageSubsteps() const
+{
+	if (!useIslands())
+		return static_cast<float>(Constants::kernelStepsPerWorldStep());
+
+	int numBodies = 0;
+	int total = 0;
+	for (int i = 0; i < islands.size(); i++)
+	{
+		numBodies += islands[i]->bodies.size();
+		total += islands[i]->bodies.size() * islands[i]->getSubsteps();
+	}
+	return numBodies > 0 ? static_cast<float>(total) / numBodies : 0.0f;
+}
+
 void Kernel::insertBody(RBX::Body *b)
 {
 	kernelData->bodies.fastAppend(b);
+	b->getSimBody()->getArena()->moveTo(b->getSimBody(), kernelData->simBodies);
+	islandsDirty = true;
 }
 
 inline void Kernel::insertPoint(RBX::Point *p)
 {
 	RBXASSERT(!inStepCode);
 	kernelData->points.fastAppend(p);
+	kernelData->pointIndex.insert(p);
+	islandsDirty = true;
 }
 
 void Kernel::insertConnector(RBX::Connector *c)
 {
 	RBXASSERT(!inStepCode);
 	kernelData->connectors.fastAppend(c);
+	kernelData->unclassifiedConnectors.fastAppend(c);
+	islandsDirty = true;
 }
 
 void Kernel::insertConnector2ndPass(RBX::Connector *c)
 {
 	RBXASSERT(!inStepCode);
 	kernelData->connectors2ndPass.fastAppend(c);
+	islandsDirty = true;
 }
 
 void Kernel::removeBody(Body *b) 
 {
 	RBXASSERT(!inStepCode);
 	kernelData->bodies.fastRemove(b);
+	kernelData->simBodies.moveTo(b->getSimBody(), SimBodyArena::detached());
+	islandsDirty = true;
 }
 
 inline void Kernel::removePoint(RBX::Point *p)
 {
 	RBXASSERT(!inStepCode);
 	kernelData->points.fastRemove(p);
+	kernelData->pointIndex.remove(p);
+	islandsDirty = true;
+}
+
+static bool throttleSetContains(const IndexArray<Connector, &Connector::getThrottleIndex>& set, Connector* c)
+{
+	int index = c->getThrottleIndex();
+	return index >= 0 && index < set.size() && set.underlyingArray()[index] == c;
+}
+
+static void removeFromThrottleSet(KernelData& data, Connector* c)
+{
+	if (throttleSetContains(data.realTimeConnectors, c))
+		data.realTimeConnectors.fastRemove(c);
+	else if (throttleSetContains(data.throttleConnectors, c))
+		data.throttleConnectors.fastRemove(c);
+	else
+		data.unclassifiedConnectors.fastRemove(c);
+}
+
+// Bodies are only known once a connector is classified, so that is when it joins their lists
+void Kernel::linkThrottleBodies(Connector* c)
+{
+	for (int i = 0; i < c->numBodies(); i++)
+	{
+		Body* body = c->getBody(i);
+		Connector::BodyLink& link = c->getBodyLink(i);
+		RBXASSERT(!link.body);
+
+		Connector*& first = body->getFirstThrottleConnector();
+		link.body = body;
+		link.next = first;
+		link.prev = NULL;
+		if (first)
+			first->getBodyLink(body).prev = c;
+		first = c;
+		body->getThrottleKernel() = this;
+	}
+}
+
+void Kernel::unlinkThrottleBodies(Connector* c)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		Connector::BodyLink& link = c->getBodyLink(i);
+		if (!link.body)
+			continue;
+
+		if (link.next)
+			link.next->getBodyLink(link.body).prev = link.prev;
+		if (link.prev)
+			link.prev->getBodyLink(link.body).next = link.next;
+		else
+			link.body->getFirstThrottleConnector() = link.next;
+
+		if (!link.body->getFirstThrottleConnector())
+			link.body->getThrottleKernel() = NULL;
+		link.body = NULL;
+		link.next = NULL;
+		link.prev = NULL;
+	}
+}
+
+// Only connectors that are new, or that read a body whose canThrottle changed, are checked
+void Kernel::classifyConnectors()
+{
+	IndexArray<Connector, &Connector::getThrottleIndex>& unclassified = kernelData->unclassifiedConnectors;
+	while (unclassified.size() > 0)
+	{
+		Connector* c = unclassified[unclassified.size() - 1];
+		unclassified.fastRemove(c);
+
+		bool throttleable = c->canThrottle();
+		c->setThrottleable(throttleable);
+		if (throttleable)
+			kernelData->throttleConnectors.fastAppend(c);
+		else
+			kernelData->realTimeConnectors.fastAppend(c);
+
+		if (!c->getBodyLink(0).body)
+			linkThrottleBodies(c);
+	}
+}
+
+void Kernel::onCanThrottleChanged(Body* b)
+{
+	RBXASSERT(!inStepCode);
+	for (Connector* c = b->getFirstThrottleConnector(); c != NULL; c = c->getBodyLink(b).next)
+	{
+		if (!throttleSetContains(kernelData->unclassifiedConnectors, c))
+		{
+			removeFromThrottleSet(*kernelData, c);
+			kernelData->unclassifiedConnectors.fastAppend(c);
+		}
+	}
 }
 
 void Kernel::removeConnector(RBX::Connector *c)
 {
 	RBXASSERT(!inStepCode);
-	realTimeConnectors.resize(0, false);
 	kernelData->connectors.fastRemove(c);
+	removeFromThrottleSet(*kernelData, c);
+	unlinkThrottleBodies(c);
+	islandsDirty = true;
 }
 
 void Kernel::removeConnector2ndPass(RBX::Connector *c) 
 {
 	RBXASSERT(!inStepCode);
 	kernelData->connectors2ndPass.fastRemove(c);
+	islandsDirty = true;
 }
 
 int Kernel::numBodies() const { return kernelData->bodies.size(); }
@@ -78,20 +240,18 @@ int Kernel::numConnectors() const { return kernelData->connectors.size(); }
 Point* Kernel::newPoint(Body* _body, const G3D::Vector3& worldPos)
 {
 	RBXASSERT(!inStepCode);
-	Point* nPoint = new Point(_body);
+	Point key(_body);
 
-	nPoint->setWorldPos(worldPos);
+	key.setWorldPos(worldPos);
 
 	//find any pre-existing point
-	for (int i = 0; i < kernelData->points.size(); i++)
+	if (Point* existing = kernelData->pointIndex.find(&key))
 	{
-		if (Point::sameBodyAndOffset(*nPoint, *kernelData->points[i]))
-		{
-			kernelData->points[i]->numOwners++;
-			delete nPoint;
-			return kernelData->points[i];
-		}
+		existing->numOwners++;
+		return existing;
 	}
+	Point* nPoint = new (kernelData->pointPool.allocate()) Point(_body);
+	nPoint->setWorldPos(worldPos);
 	insertPoint(nPoint);
 	return nPoint;
 }
@@ -106,17 +266,31 @@ void Kernel::deletePoint(RBX::Point* _point)
 		if (_point->numOwners == 0) 
 		{
 			removePoint(_point);
-			delete _point;
+			kernelData->pointPool.destroy(_point);
 		}
 	}
 }
 
+ContactConnector* Kernel::newContactConnector(float k, float kNeg, float kFriction)
+{
+	ContactConnector* c = new (kernelData->contactConnectorPool.allocate()) ContactConnector(k, kNeg, kFriction);
+	insertConnector(c);
+	return c;
+}
+
+void Kernel::deleteContactConnector(ContactConnector* c)
+{
+	removeConnector(c);
+	kernelData->contactConnectorPool.destroy(c);
+}
+
 void Kernel::stepWorld(int worldStepId, int uiStepId, bool throttling) 
 {
 	IndexArray<Body, &Body::getKernelIndex>& bodies = kernelData->bodies;
 	IndexArray<Point, &Point::getKernelIndex>& points = kernelData->points;
 	IndexArray<Connector, &Connector::getKernelIndex>& connectors = kernelData->connectors;
 	IndexArray<Connector, &Connector::getKernelIndex>& connectors2ndPass = kernelData->connectors2ndPass;
+	SimBodyArena& simBodies = kernelData->simBodies;
 
 	RBXASSERT(!inStepCode);
 	inStepCode = true;
@@ -124,15 +298,28 @@ void Kernel::stepWorld(int worldStepId, int uiStepId, bool throttling)
 	float kernelDt = Constants::kernelDt();
 	int kernelSteps = Constants::kernelStepsPerWorldStep();
 
-	if (throttling) {
-		realTimeConnectors.resize(0, false);
+	if (throttling)
+		classifyConnectors();
 
-		for (int i = 0; i < connectors.size(); i++){
-			if (!connectors[i]->canThrottle())
-			{
-				realTimeConnectors.append(connectors[i]);
-			}
-		}
+	if (useIslands())
+	{
+		stepIslands(throttling);
+		inStepCode = false;
+		return;
+	}
+
+	ConnectorBatches& connectorBatches = kernelData->connectorBatches;
+	ConnectorBatches& connectorBatches2ndPass = kernelData->connectorBatches2ndPass;
+	if (throttling)
+		connectorBatches.fill(kernelData->realTimeConnectors, false);
+	else
+		connectorBatches.fill(connectors, false);
+	connectorBatches2ndPass.fill(connectors2ndPass, false);
+
+	RBXASSERT(simBodies.size() == bodies.size());
+	for (int j = 0; j < bodies.size(); j++)
+	{
+		bodies[j]->beginStep(throttling);
 	}
 
 	for (int i = 0; i < kernelSteps; i++)
@@ -142,37 +329,364 @@ void Kernel::stepWorld(int worldStepId, int uiStepId, bool throttling)
 			points[j]->step();
 		}
 
-		if (throttling)
+		connectorBatches.computeForces(kernelDt, throttling);
+
+		for (int j = 0; j < points.size(); j++)
 		{
-			for (int j = 0; j < realTimeConnectors.size(); j++)
-			{
-				realTimeConnectors[j]->computeForce(kernelDt, throttling);
-			}
+			points[j]->forceToBody();
 		}
-		else
+
+		connectorBatches2ndPass.computeForces(kernelDt, throttling);
+
+		simBodies.step(kernelDt);
+
+		for (int j = 0; j < bodies.size(); j++)
 		{
-			for (int j = 0; j < connectors.size(); j++)
-			{
-				connectors[j]->computeForce(kernelDt, throttling);
-			}
+			bodies[j]->endStep();
 		}
+	}
+	inStepCode = false;
+}
 
-		for (int j = 0; j < points.size(); j++)
+static int findIslandRoot(G3D::Array<int>& parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+static void unionIslands(G3D::Array<int>& parent, int a, int b)
+{
+	a = findIslandRoot(parent, a);
+	b = findIslandRoot(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else if (b < a)
+		parent[a] = b;
+}
+
+// Elements are kernel bodies [0, numBodies) followed by points [numBodies, numBodies + numPoints).
+// Bodies outside the kernel (anchored, world body) are static and never join islands; a point on
+// a static body is its own element so that connectors sharing it still end up in the same island.
+static int bodyElement(Body* body)
+{
+	return body->getRoot()->getKernelIndex();
+}
+
+static int pointElement(Point* point, int numBodies)
+{
+	int element = bodyElement(point->getBody());
+	if (element == -1)
+	{
+		RBXASSERT(point->getKernelIndex() != -1);
+		element = numBodies + point->getKernelIndex();
+	}
+	return element;
+}
+
+static int connectorElement(Connector* c, G3D::Array<int>& parent, int numBodies)
+{
+	int first = -1;
+	for (int i = 0; i < c->numBodies(); i++)
+	{
+		int element = bodyElement(c->getBody(i));
+		if (element != -1)
 		{
-			points[j]->forceToBody();
+			if (first == -1)
+				first = element;
+			else
+				unionIslands(parent, first, element);
 		}
+	}
+	for (int i = 0; i < c->numPoints(); i++)
+	{
+		int element = pointElement(c->getPoint(i), numBodies);
+		if (first == -1)
+			first = element;
+		else
+			unionIslands(parent, first, element);
+	}
+	return first;
+}
+
+static int islandComponent(int element, G3D::Array<int>& parent, G3D::Array<int>& componentOfRoot, int& staticComponent, G3D::Array<int>& componentCost)
+{
+	int& component = (element == -1) ? staticComponent : componentOfRoot[findIslandRoot(parent, element)];
+	if (component == -1)
+	{
+		component = componentCost.size();
+		componentCost.append(0);
+	}
+	componentCost[component]++;
+	return component;
+}
+
+void Kernel::clearIslands()
+{
+	for (int i = 0; i < islands.size(); i++)
+	{
+		delete islands[i];
+	}
+	islands.fastClear();
+	islandTasks.fastClear();
 
-		for (int j = 0; j < connectors2ndPass.size(); j++)
+	for (int i = 0; i < components.size(); i++)
+	{
+		delete components[i];
+	}
+	components.fastClear();
+	componentSubsteps.fastClear();
+}
+
+static void resizeIslands(G3D::Array<KernelIsland*>& islands, G3D::Array<WorkerPool::Task*>* tasks, int size, SimBodyArena* simBodies)
+{
+	while (islands.size() < size)
+	{
+		islands.append(new KernelIsland());
+		if (tasks)
+			tasks->append(islands.last());
+	}
+	while (islands.size() > size)
+	{
+		delete islands.pop();
+		if (tasks)
+			tasks->pop();
+	}
+	for (int i = 0; i < islands.size(); i++)
+	{
+		islands[i]->clear();
+		islands[i]->simBodies = simBodies;
+	}
+}
+
+// Splits the kernel into connected components and packs them into roughly equal sized tasks.
+// With adaptive substepping the components are kept apart here and packed every step instead,
+// see packComponents.
+void Kernel::buildIslands()
+{
+	IndexArray<Body, &Body::getKernelIndex>& bodies = kernelData->bodies;
+	IndexArray<Point, &Point::getKernelIndex>& points = kernelData->points;
+	IndexArray<Connector, &Connector::getKernelIndex>& connectors = kernelData->connectors;
+	IndexArray<Connector, &Connector::getKernelIndex>& connectors2ndPass = kernelData->connectors2ndPass;
+
+	int numBodies = bodies.size();
+	int numElements = numBodies + points.size();
+
+	G3D::Array<int> parent;
+	parent.resize(numElements, false);
+	for (int i = 0; i < numElements; i++)
+		parent[i] = i;
+
+	G3D::Array<int> connectorElements;
+	connectorElements.resize(connectors.size(), false);
+	for (int i = 0; i < connectors.size(); i++)
+		connectorElements[i] = connectorElement(connectors[i], parent, numBodies);
+
+	G3D::Array<int> connector2ndPassElements;
+	connector2ndPassElements.resize(connectors2ndPass.size(), false);
+	for (int i = 0; i < connectors2ndPass.size(); i++)
+		connector2ndPassElements[i] = connectorElement(connectors2ndPass[i], parent, numBodies);
+
+	// number the components in order of first appearance; connectors touching only static bodies share one extra component
+	G3D::Array<int> componentOfRoot;
+	componentOfRoot.resize(numElements, false);
+	for (int i = 0; i < numElements; i++)
+		componentOfRoot[i] = -1;
+
+	G3D::Array<int> componentCost;
+	int staticComponent = -1;
+
+	G3D::Array<int> bodyComponent, pointComponent, connectorComponent, connector2ndPassComponent;
+	bodyComponent.resize(numBodies, false);
+	pointComponent.resize(points.size(), false);
+	connectorComponent.resize(connectors.size(), false);
+	connector2ndPassComponent.resize(connectors2ndPass.size(), false);
+
+	for (int i = 0; i < numBodies; i++)
+		bodyComponent[i] = islandComponent(i, parent, componentOfRoot, staticComponent, componentCost);
+	for (int i = 0; i < points.size(); i++)
+		pointComponent[i] = islandComponent(pointElement(points[i], numBodies), parent, componentOfRoot, staticComponent, componentCost);
+	for (int i = 0; i < connectors.size(); i++)
+		connectorComponent[i] = islandComponent(connectorElements[i], parent, componentOfRoot, staticComponent, componentCost);
+	for (int i = 0; i < connectors2ndPass.size(); i++)
+		connector2ndPassComponent[i] = islandComponent(connector2ndPassElements[i], parent, componentOfRoot, staticComponent, componentCost);
+
+	// pack components into tasks - a few tasks per thread leaves room for stealing
+	int totalCost = numElements + connectors.size() + connectors2ndPass.size();
+	islandTargetCost = totalCost / (4 * (getNumThreads() + 1));
+	if (islandTargetCost < minIslandCost())
+		islandTargetCost = minIslandCost();
+
+	G3D::Array<int> taskOfComponent;
+	taskOfComponent.resize(componentCost.size(), false);
+	int numTasks = 0;
+	int currentCost = 0;
+	for (int i = 0; i < componentCost.size(); i++)
+	{
+		if (adaptiveSubsteps)
 		{
-			connectors2ndPass[j]->computeForce(kernelDt, throttling);
+			taskOfComponent[i] = i;
+			continue;
 		}
 
-		for (int j = 0; j < bodies.size(); j++)
+		if (currentCost == 0)
+			numTasks++;
+		taskOfComponent[i] = numTasks - 1;
+		currentCost += componentCost[i];
+		if (currentCost >= islandTargetCost)
+			currentCost = 0;
+	}
+
+	G3D::Array<KernelIsland*>& target = adaptiveSubsteps ? components : islands;
+	if (adaptiveSubsteps)
+		resizeIslands(components, NULL, componentCost.size(), &kernelData->simBodies);
+	else
+	{
+		resizeIslands(islands, &islandTasks, numTasks, &kernelData->simBodies);
+		resizeIslands(components, NULL, 0, &kernelData->simBodies);
+	}
+	componentSubsteps.fastClear();
+
+	for (int i = 0; i < numBodies; i++)
+	{
+		KernelIsland* island = target[taskOfComponent[bodyComponent[i]]];
+		island->bodies.append(bodies[i]);
+		island->simBodySlots.append(bodies[i]->getSimBody()->getArenaIndex());
+	}
+	for (int i = 0; i < points.size(); i++)
+		target[taskOfComponent[pointComponent[i]]]->points.append(points[i]);
+	for (int i = 0; i < connectors.size(); i++)
+		target[taskOfComponent[connectorComponent[i]]]->connectors.append(connectors[i]);
+	for (int i = 0; i < connectors2ndPass.size(); i++)
+		target[taskOfComponent[connector2ndPassComponent[i]]]->connectors2ndPass.append(connectors2ndPass[i]);
+
+	islandsDirty = false;
+}
+
+class SubstepsOrder
+{
+public:
+	const G3D::Array<int>* substeps;
+	bool operator()(int a, int b) const {return (*substeps)[a] < (*substeps)[b];}
+};
+
+// A task takes the substep count of its most demanding component, so only components that chose the
+// same count share one - packed up to the usual task size, in component order within each count.
+// Thousands of resting bodies then step as a few tasks rather than one tiny task each.
+// The packing is kept until some component's count changes.
+void Kernel::packComponents()
+{
+	bool changed = componentSubsteps.size() != components.size();
+	componentSubsteps.resize(components.size(), false);
+	for (int i = 0; i < components.size(); i++)
+	{
+		int substeps = components[i]->pickSubsteps();
+		if (changed || substeps != componentSubsteps[i])
 		{
-			bodies[j]->step(kernelDt, throttling);
+			changed = true;
+			componentSubsteps[i] = substeps;
 		}
 	}
-	inStepCode = false;
+	if (!changed)
+		return;
+
+	G3D::Array<int> order;
+	order.resize(components.size(), false);
+	for (int i = 0; i < order.size(); i++)
+		order[i] = i;
+	SubstepsOrder bySubsteps;
+	bySubsteps.substeps = &componentSubsteps;
+	std::stable_sort(order.begin(), order.end(), bySubsteps);
+
+	G3D::Array<int> taskOfOrder;
+	taskOfOrder.resize(order.size(), false);
+	int numTasks = 0;
+	int currentCost = 0;
+	for (int i = 0; i < order.size(); i++)
+	{
+		bool sameSubsteps = i > 0 && componentSubsteps[order[i]] == componentSubsteps[order[i - 1]];
+		if (currentCost == 0 || !sameSubsteps)
+		{
+			numTasks++;
+			currentCost = 0;
+		}
+		taskOfOrder[i] = numTasks - 1;
+		currentCost += components[order[i]]->cost();
+		if (currentCost >= islandTargetCost)
+			currentCost = 0;
+	}
+
+	resizeIslands(islands, &islandTasks, numTasks, &kernelData->simBodies);
+	for (int i = 0; i < order.size(); i++)
+	{
+		KernelIsland* island = islands[taskOfOrder[i]];
+		island->append(*components[order[i]]);
+		island->setSubsteps(componentSubsteps[order[i]]);
+	}
+}
+
+void Kernel::stepIslands(bool throttling)
+{
+	RBXASSERT(useIslands());
+	if (islandsDirty)
+		buildIslands();
+
+	// static bodies can be read by several islands at once - bring their pv up to date here so tasks only read them
+	for (int i = 0; i < kernelData->points.size(); i++)
+	{
+		kernelData->points[i]->getBody()->getPV();
+	}
+	for (int i = 0; i < kernelData->connectors.size(); i++)
+	{
+		Connector* c = kernelData->connectors[i];
+		for (int j = 0; j < c->numBodies(); j++)
+			c->getBody(j)->getPV();
+	}
+	for (int i = 0; i < kernelData->connectors2ndPass.size(); i++)
+	{
+		Connector* c = kernelData->connectors2ndPass[i];
+		for (int j = 0; j < c->numBodies(); j++)
+			c->getBody(j)->getPV();
+	}
+
+	for (int i = 0; i < kernelData->bodies.size(); i++)
+	{
+		kernelData->bodies[i]->beginStep(throttling);
+	}
+
+	// components pick the substeps, the islands packed from them run them
+	for (int pass = 0; pass < 2; pass++)
+	{
+		G3D::Array<KernelIsland*>& list = pass == 0 ? components : islands;
+		for (int i = 0; i < list.size(); i++)
+		{
+			list[i]->throttling = throttling;
+			list[i]->adaptiveSubsteps = adaptiveSubsteps;
+			list[i]->minSubsteps = minSubsteps;
+			list[i]->maxSubsteps = maxSubsteps;
+			list[i]->semiImplicit = semiImplicit;
+		}
+
+		if (pass == 0 && adaptiveSubsteps)
+			packComponents();
+	}
+
+	if (!adaptiveSubsteps)
+	{
+		for (int i = 0; i < islands.size(); i++)
+			islands[i]->setSubsteps(islands[i]->pickSubsteps());
+	}
+
+	if (workerPool)
+		workerPool->run(islandTasks.getCArray(), islandTasks.size());
+	else
+	{
+		for (int i = 0; i < islands.size(); i++)
+			islands[i]->run();
+	}
 }
 
 float Kernel::connectorSpringEnergy() const
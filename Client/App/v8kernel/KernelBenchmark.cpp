@@ -0,0 +1,120 @@
+#include "v8kernel/KernelBenchmark.h"
+#include "v8kernel/Kernel.h"
+#include "v8kernel/Body.h"
+#include "v8kernel/Point.h"
+#include "v8kernel/Connector.h"
+#include "v8kernel/Constants.h"
+#include "util/Units.h"
+#include "util/Math.h"
+
+namespace RBX {
+
+double KernelBenchmark::Result::secondsPerSimulatedSecond() const
+{
+	return seconds / (worldSteps * Constants::worldDt());
+}
+
+// Gravitational energy is measured from floorY, below anywhere the chain can swing to, so the
+// starting energy isn't zero. points holds each joint's two ends in order.
+static float chainEnergy(const Kernel& kernel, const G3D::Array<Body*>& bodies, const G3D::Array<Point*>& points, float k, float floorY)
+{
+	float gravity = -Units::kmsAccelerationToRbx(Constants::getKmsGravity()).y;
+	float energy = kernel.totalKineticEnergy();
+	for (int i = 0; i < bodies.size(); i++)
+	{
+		energy += bodies[i]->getMass() * gravity * (bodies[i]->getPV().position.translation.y - floorY);
+	}
+	for (int i = 0; i + 1 < points.size(); i += 2)
+	{
+		points[i]->step();
+		points[i + 1]->step();
+		energy += 0.5f * k * (points[i + 1]->getWorldPos() - points[i]->getWorldPos()).squaredLength();
+	}
+	return energy;
+}
+
+KernelBenchmark::Result KernelBenchmark::runSpringChain(bool semiImplicit, int numLinks, int worldSteps, int substeps)
+{
+	RBXASSERT(numLinks > 0);
+	RBXASSERT(substeps >= 0);
+
+	Kernel kernel(NULL);
+	kernel.setSemiImplicit(semiImplicit);
+	if (substeps > 0)
+		kernel.setAdaptiveSubsteps(true, substeps, substeps);
+
+	// 4x1.2x2 bricks glued end to end, released horizontally from a fixed anchor
+	G3D::Vector3 size(4.0f, 1.2f, 2.0f);
+	float k = Constants::getJointK(size, false);
+	float mass = size.x * size.y * size.z;
+	G3D::Matrix3 moment(
+		mass * (size.y * size.y + size.z * size.z) / 12.0f, 0.0f, 0.0f,
+		0.0f, mass * (size.x * size.x + size.z * size.z) / 12.0f, 0.0f,
+		0.0f, 0.0f, mass * (size.x * size.x + size.y * size.y) / 12.0f);
+
+	// never inserted in the kernel, so it is immovable
+	Body anchor;
+	G3D::Array<Body*> bodies;
+	G3D::Array<Point*> points;
+	G3D::Array<Connector*> connectors;
+
+	Body* previous = &anchor;
+	for (int i = 0; i < numLinks; i++)
+	{
+		Body* body = new Body();
+		body->setMass(mass);
+		body->setMoment(moment);
+		body->setCoordinateFrame(G3D::CoordinateFrame(G3D::Vector3(size.x * (i + 1), 0.0f, 0.0f)));
+		kernel.insertBody(body);
+		bodies.append(body);
+
+		G3D::Vector3 joint(size.x * (i + 0.5f), 0.0f, 0.0f);
+		Point* p0 = kernel.newPoint(previous, joint);
+		Point* p1 = kernel.newPoint(body, joint);
+		points.append(p0);
+		points.append(p1);
+
+		Connector* connector = new PointToPointBreakConnector(p0, p1, k, Math::inf());
+		kernel.insertConnector(connector);
+		connectors.append(connector);
+
+		previous = body;
+	}
+
+	// one link length of slack below the chain hanging straight down
+	float floorY = -(numLinks + 1) * size.x;
+
+	Result result;
+	result.worldSteps = worldSteps;
+	result.initialEnergy = chainEnergy(kernel, bodies, points, k, floorY);
+
+	float totalSubsteps = 0.0f;
+	double start = G3D::System::time();
+	for (int i = 0; i < worldSteps; i++)
+	{
+		kernel.stepWorld(i, 0, false);
+		totalSubsteps += kernel.averageSubsteps();
+	}
+	result.seconds = G3D::System::time() - start;
+	result.averageSubsteps = worldSteps > 0 ? totalSubsteps / worldSteps : 0.0f;
+	result.finalEnergy = chainEnergy(kernel, bodies, points, k, floorY);
+
+	for (int i = 0; i < connectors.size(); i++)
+	{
+		kernel.removeConnector(connectors[i]);
+		delete connectors[i];
+	}
+	for (int i = 0; i < points.size(); i++)
+	{
+		kernel.deletePoint(points[i]);
+	}
+	for (int i = 0; i < bodies.size(); i++)
+	{
+		kernel.removeBody(bodies[i]);
+		delete bodies[i];
+	}
+
+	return result;
+}
+
+}
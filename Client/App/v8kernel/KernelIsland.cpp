@@ -0,0 +1,177 @@
+#include "v8kernel/KernelIsland.h"
+#include "v8kernel/Body.h"
+#include "v8kernel/Point.h"
+#include "v8kernel/Connector.h"
+#include "v8kernel/Constants.h"
+#include "v8kernel/SimBodyArena.h"
+#include "util/Math.h"
+#include "util/Debug.h"
+
+namespace RBX {
+
+KernelIsland::KernelIsland()
+	:simBodies(NULL),
+	throttling(false),
+	adaptiveSubsteps(false),
+	semiImplicit(false),
+	minSubsteps(Constants::kernelStepsPerWorldStep()),
+	maxSubsteps(Constants::kernelStepsPerWorldStep()),
+	substeps(Constants::kernelStepsPerWorldStep())
+{
+}
+
+void KernelIsland::append(const KernelIsland& other)
+{
+	bodies.append(other.bodies);
+	simBodySlots.append(other.simBodySlots);
+	points.append(other.points);
+	connectors.append(other.connectors);
+	connectors2ndPass.append(other.connectors2ndPass);
+}
+
+void KernelIsland::clear()
+{
+	bodies.fastClear();
+	simBodySlots.fastClear();
+	points.fastClear();
+	connectors.fastClear();
+	connectors2ndPass.fastClear();
+	connectorBatches.clear();
+	connectorBatches2ndPass.clear();
+}
+
+static float lightestMass(Body* body, float mass)
+{
+	// anchored bodies never enter the kernel and act as infinite mass
+	Body* root = body->getRoot();
+	if (root->getKernelIndex() < 0)
+		return mass;
+	float branchMass = root->getBranchMass();
+	return branchMass < mass ? branchMass : mass;
+}
+
+// Motor input is counted in kernel steps, so islands with a RotateConnector always take the full count
+bool KernelIsland::hasMotor() const
+{
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const G3D::Array<Connector*>& list = pass == 0 ? connectors : connectors2ndPass;
+		for (int i = 0; i < list.size(); i++)
+		{
+			if (list[i]->getConnectorType() == ROTATE_CONNECTOR)
+				return true;
+		}
+	}
+	return false;
+}
+
+// Enough substeps that the stiffest spring against the lightest body it touches stays stable
+// (omega * dt under the integrator's limit) and the fastest body moves at most maxTravelPerSubstep
+// per substep, clamped to [low, high].
+int KernelIsland::chooseSubsteps(int low, int high)
+{
+	float maxOmegaSquared = 0.0f;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const G3D::Array<Connector*>& list = pass == 0 ? connectors : connectors2ndPass;
+		for (int i = 0; i < list.size(); i++)
+		{
+			Connector* c = list[i];
+			if (throttling && c->getThrottleable())
+				continue;
+
+			float k = c->getStiffness();
+			if (k <= 0.0f)
+				continue;
+
+			float mass = Math::inf();
+			for (int j = 0; j < c->numBodies(); j++)
+				mass = lightestMass(c->getBody(j), mass);
+			for (int j = 0; j < c->numPoints(); j++)
+				mass = lightestMass(c->getPoint(j)->getBody(), mass);
+			if (mass == Math::inf() || mass <= 0.0f)
+				continue;
+
+			float omegaSquared = k / mass;
+			if (omegaSquared > maxOmegaSquared)
+				maxOmegaSquared = omegaSquared;
+		}
+	}
+
+	float maxSpeedSquared = 0.0f;
+	for (int i = 0; i < bodies.size(); i++)
+	{
+		float speedSquared = bodies[i]->getPV().velocity.linear.squaredLength();
+		if (speedSquared > maxSpeedSquared)
+			maxSpeedSquared = speedSquared;
+	}
+
+	float worldDt = Constants::worldDt();
+	float omegaDt = semiImplicit ? semiImplicitOmegaDt() : stableOmegaDt();
+	float forStiffness = worldDt * sqrtf(maxOmegaSquared) / omegaDt;
+	float forSpeed = worldDt * sqrtf(maxSpeedSquared) / maxTravelPerSubstep();
+	float needed = forStiffness > forSpeed ? forStiffness : forSpeed;
+
+	if (needed >= high)
+		return high;
+	int result = static_cast<int>(ceilf(needed));
+	return result < low ? low : result;
+}
+
+void KernelIsland::computeForces(ConnectorBatches& batches, float dt)
+{
+	if (semiImplicit)
+		batches.computeSemiImplicitForces(dt, throttling);
+	else
+		batches.computeForces(dt, throttling);
+}
+
+// Semi-implicit islands choose their count even when not adaptive - that lower count is what the
+// mode is for - but never take more than the explicit kernel would.
+int KernelIsland::pickSubsteps()
+{
+	if ((!adaptiveSubsteps && !semiImplicit) || hasMotor())
+		return Constants::kernelStepsPerWorldStep();
+	if (adaptiveSubsteps)
+		return chooseSubsteps(minSubsteps, maxSubsteps);
+	return chooseSubsteps(1, Constants::kernelStepsPerWorldStep());
+}
+
+// Same substep sequence as Kernel::stepWorld, restricted to this island, with the count set by the kernel
+void KernelIsland::run()
+{
+	RBXASSERT(simBodies);
+	RBXASSERT(bodies.size() == simBodySlots.size());
+
+	float kernelDt = substeps == Constants::kernelStepsPerWorldStep() ? Constants::kernelDt() : Constants::worldDt() / substeps;
+	int kernelSteps = substeps;
+
+	connectorBatches.fill(connectors, throttling);
+	connectorBatches2ndPass.fill(connectors2ndPass, false);
+
+	for (int i = 0; i < kernelSteps; i++)
+	{
+		for (int j = 0; j < points.size(); j++)
+		{
+			points[j]->step();
+		}
+
+		computeForces(connectorBatches, kernelDt);
+
+		for (int j = 0; j < points.size(); j++)
+		{
+			points[j]->forceToBody();
+		}
+
+		computeForces(connectorBatches2ndPass, kernelDt);
+
+		simBodies->step(kernelDt, simBodySlots.getCArray(), simBodySlots.size());
+
+		for (int j = 0; j < bodies.size(); j++)
+		{
+			bodies[j]->endStep();
+		}
+	}
+}
+
+}
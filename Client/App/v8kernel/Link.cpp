@@ -3,10 +3,11 @@
 
 using namespace RBX;
 
-Link::Link():body(NULL) {stateIndex = Body::getNextStateIndex();}
+Link::Link():body(NULL), childInParentDirty(true) {}
 
 void Link::dirty()
 {
+	childInParentDirty = true;
 	if (body)
 	{
 		RBXASSERT(body->getLink() == this);
@@ -16,16 +17,19 @@ void Link::dirty()
 
 const G3D::CoordinateFrame& Link::getChildInParent() const
 {
-	int bodyStateIndex = body->getParent()->getStateIndex();
-
-	if (stateIndex != bodyStateIndex)
+	if (childInParentDirty)
 	{
 		computeChildInParent(childInParent);
-		stateIndex = bodyStateIndex;
+		childInParentDirty = false;
 	}
 	return childInParent;
 }
 
+void Link::computeChildInParent(G3D::CoordinateFrame& answer) const
+{
+	answer = parentCoord * childCoordInverse;
+}
+
 void RevoluteLink::computeChildInParent(G3D::CoordinateFrame& answer) const
 {
     G3D::CoordinateFrame rotatedParentCoord(
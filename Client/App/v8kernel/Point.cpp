@@ -5,6 +5,7 @@ using namespace RBX;
 
 Point::Point(Body* _body)
 	:numOwners(1),
+	nextInBucket(NULL),
 	body(_body ? _body : Body::getWorldBody()),
 	localPos(0, 0, 0),
 	worldPos(0, 0, 0),
@@ -0,0 +1,86 @@
+#include "v8kernel/PointIndex.h"
+#include "v8kernel/Point.h"
+#include "util/Math.h"
+#include "util/Debug.h"
+
+namespace RBX {
+
+PointIndex::PointIndex()
+	:numPoints(0)
+{
+	buckets.resize(64, false);
+	for (int i = 0; i < buckets.size(); i++)
+		buckets[i] = NULL;
+}
+
+PointIndex::~PointIndex()
+{
+	RBXASSERT(numPoints == 0);
+}
+
+size_t PointIndex::hash(const Point* point)
+{
+	size_t h = Math::hash(point->localPos);
+	size_t b = reinterpret_cast<size_t>(point->body);
+	return h ^ ((b >> 4) * 2654435761u);
+}
+
+void PointIndex::rehash(int numBuckets)
+{
+	G3D::Array<Point*> old = buckets;
+	buckets.resize(numBuckets, false);
+	for (int i = 0; i < numBuckets; i++)
+		buckets[i] = NULL;
+
+	for (int i = 0; i < old.size(); i++)
+	{
+		Point* point = old[i];
+		while (point)
+		{
+			Point* next = point->nextInBucket;
+			int bucket = bucketOf(point);
+			point->nextInBucket = buckets[bucket];
+			buckets[bucket] = point;
+			point = next;
+		}
+	}
+}
+
+Point* PointIndex::find(const Point* point) const
+{
+	for (Point* candidate = buckets[bucketOf(point)]; candidate; candidate = candidate->nextInBucket)
+	{
+		if (Point::sameBodyAndOffset(*point, *candidate))
+			return candidate;
+	}
+	return NULL;
+}
+
+void PointIndex::insert(Point* point)
+{
+	RBXASSERT(!point->nextInBucket);
+	RBXASSERT(!find(point));
+
+	if (numPoints >= buckets.size())
+		rehash(buckets.size() * 2);
+
+	int bucket = bucketOf(point);
+	point->nextInBucket = buckets[bucket];
+	buckets[bucket] = point;
+	numPoints++;
+}
+
+void PointIndex::remove(Point* point)
+{
+	Point** link = &buckets[bucketOf(point)];
+	while (*link != point)
+	{
+		RBXASSERT(*link);
+		link = &(*link)->nextInBucket;
+	}
+	*link = point->nextInBucket;
+	point->nextInBucket = NULL;
+	numPoints--;
+}
+
+}
@@ -6,14 +6,19 @@ namespace RBX
 {
 
 SimBody::SimBody(RBX::Body* _body)
-			:body(_body),
-			dirty(1),
-			force(Vector3::zero()),
-			torque(Vector3::zero()),
-			constantForceY(0.0f)
-{}
+			:arena(NULL),
+			arenaIndex(-1),
+			body(_body),
+			dirty(1)
+{
+	SimBodyArena::detached().insert(this);
+}
 
-SimBody::~SimBody() {}
+SimBody::~SimBody()
+{
+	RBXASSERT(arena);
+	arena->remove(this);
+}
 
 G3D::Vector3 vecUnkPercent(G3D::Vector3& input)
 {
@@ -27,8 +32,8 @@ float precentInline(float fNum)
 
 __forceinline void SimBody::unkSimInline(float fNum)
 {
-	massRecip = 1.0f / fNum;
-	momentRecip = vecUnkPercent(Math::toDiagonal(body->getBranchIBody()));
+	arena->massRecip[arenaIndex] = 1.0f / fNum;
+	arena->momentRecip[arenaIndex] = vecUnkPercent(Math::toDiagonal(body->getBranchIBody()));
 }
 
 void SimBody::update()
@@ -36,14 +41,17 @@ void SimBody::update()
 	RBXASSERT(dirty);
 	{
 		const G3D::Vector3 cofmOffset = body->getCofmOffset();
-		pv = body->getPV().pvAtLocalOffset(cofmOffset);
+		PV pv = body->getPV().pvAtLocalOffset(cofmOffset);
+		arena->position[arenaIndex] = pv.position;
+		arena->velocity[arenaIndex] = pv.velocity;
 	}
-	qOrientation = Quaternion::Quaternion(pv.position.rotation);
+	Quaternion& qOrientation = arena->qOrientation[arenaIndex];
+	qOrientation = Quaternion::Quaternion(arena->position[arenaIndex].rotation);
 	qOrientation *= precentInline(qOrientation.magnitude());
-	angMomentum = pv.velocity.rotational * body->getBranchIWorld();
+	arena->angMomentum[arenaIndex] = arena->velocity[arenaIndex].rotational * body->getBranchIWorld();
 	float _mass = body->getBranchMass();
 	unkSimInline(_mass);
-	constantForceY = body->getBranchMass() * Units::kmsAccelerationToRbx(Constants::getKmsGravity()).y;
+	arena->constantForceY[arenaIndex] = body->getBranchMass() * Units::kmsAccelerationToRbx(Constants::getKmsGravity()).y;
 	dirty = false;
 }
 
@@ -94,6 +102,20 @@ G3D::Vector3 computeRotVel(const G3D::Matrix3& rot, const G3D::Vector3& momentRe
 	return iWorldInv * angMomentum;
 }
 
+float SimBody::inverseMassAlong(const G3D::Vector3& worldPos, const G3D::Vector3& direction) const
+{
+	if (!arena->accumulates)
+		return 0.0f;
+
+	const CoordinateFrame& cofm = arena->position[arenaIndex];
+	const Vector3& momentRecip = arena->momentRecip[arenaIndex];
+	Vector3 arm = cofm.vectorToObjectSpace((worldPos - cofm.translation).cross(direction));
+	return arena->massRecip[arenaIndex]
+		+ arm.x * arm.x * momentRecip.x
+		+ arm.y * arm.y * momentRecip.y
+		+ arm.z * arm.z * momentRecip.z;
+}
+
 //temporary for now?
 G3D::Vector3& denormFixFunc()
 {
@@ -103,42 +125,83 @@ G3D::Vector3& denormFixFunc()
 
 void SimBody::step(float dt)
 {
+	updateIfDirty();
+	arena->step(dt, arenaIndex, arenaIndex + 1);
+}
+
+void SimBodyArena::step(float dt, int begin, int end)
+{
+	RBXASSERT(begin >= 0 && end <= size());
+	stepSlots(dt, NULL, begin, end);
+}
+
+void SimBodyArena::step(float dt, const int* slots, int numSlots)
+{
+	stepSlots(dt, slots, 0, numSlots);
+}
+
+// Batch version of the original per-body integrator. Owners must be clean (see Body::beginStep);
+// frozen slots only have their accumulators reset.
+void SimBodyArena::stepSlots(float dt, const int* slots, int begin, int end)
+{
+
 	//line 103
 	//static G3D::Vector3 denormFix = Vector3(9.9999997e-21f, 9.9999997e-21f, 9.9999997e-21f);
 	G3D::Vector3& denormFix = denormFixFunc();
-	//line 109
-	updateIfDirty();
 	//line 115?
 	float someConstant = 0.99980003f;
-	//line 117
-	angMomentum = torque * dt + angMomentum * someConstant;
-	pv.velocity.rotational = computeRotVel(getPV().position.rotation, momentRecip, angMomentum) + denormFix;
-	//line 118
-	Quaternion& rotateQuat = Quaternion::Quaternion(getPV().velocity.rotational, 0) * qOrientation * 0.5 * dt;
-	//line 119
-	qOrientation += rotateQuat;
-	// line 121
-	qOrientation *= precentInline(qOrientation.magnitude());
-	qOrientation.toRotationMatrix(pv.position.rotation);
-	//line 123
-	pv.velocity.linear += force * massRecip * dt;
-	pv.position.translation += getPV().velocity.linear * dt;
-	//line 129
-	force = Vector3(0, constantForceY, 0);
-	torque = Vector3(0, 0, 0);
-	//line 131
-	angMomentum += denormFix;
-	//line 132
-	pv.velocity.linear += denormFix;
+	// the damping factor is per kernel step - keep it per second when stepping at another dt
+	if (dt != Constants::kernelDt())
+		someConstant = powf(someConstant, dt * Constants::kernelStepsPerSec());
+
+	G3D::CoordinateFrame* position = this->position.getCArray();
+	Velocity* velocity = this->velocity.getCArray();
+	Quaternion* qOrientation = this->qOrientation.getCArray();
+	G3D::Vector3* angMomentum = this->angMomentum.getCArray();
+	const G3D::Vector3* momentRecip = this->momentRecip.getCArray();
+	const float* massRecip = this->massRecip.getCArray();
+	const float* constantForceY = this->constantForceY.getCArray();
+	G3D::Vector3* force = this->force.getCArray();
+	G3D::Vector3* torque = this->torque.getCArray();
+	const bool* frozen = this->frozen.getCArray();
+
+	for (int n = begin; n < end; n++)
+	{
+		int i = slots ? slots[n] : n;
+		RBXASSERT(!owners[i]->getDirty());
+
+		if (!frozen[i])
+		{
+			//line 117
+			angMomentum[i] = torque[i] * dt + angMomentum[i] * someConstant;
+			velocity[i].rotational = computeRotVel(position[i].rotation, momentRecip[i], angMomentum[i]) + denormFix;
+			//line 118
+			Quaternion& rotateQuat = Quaternion::Quaternion(velocity[i].rotational, 0) * qOrientation[i] * 0.5 * dt;
+			//line 119
+			qOrientation[i] += rotateQuat;
+			// line 121
+			qOrientation[i] *= precentInline(qOrientation[i].magnitude());
+			qOrientation[i].toRotationMatrix(position[i].rotation);
+			//line 123
+			velocity[i].linear += force[i] * massRecip[i] * dt;
+			position[i].translation += velocity[i].linear * dt;
+			//line 131
+			angMomentum[i] += denormFix;
+			//line 132
+			velocity[i].linear += denormFix;
+		}
 
-	
+		//line 129
+		force[i] = Vector3(0, constantForceY[i], 0);
+		torque[i] = Vector3(0, 0, 0);
+	}
 }
 
 PV SimBody::getOwnerPV()
 {
 	RBXASSERT(!dirty);
 	G3D::Vector3 cofmOffset = body->getCofmOffset();
-	return pv.pvAtLocalOffset(Vector3(-cofmOffset.x, -cofmOffset.y, -cofmOffset.z));
+	return getPV().pvAtLocalOffset(Vector3(-cofmOffset.x, -cofmOffset.y, -cofmOffset.z));
 }
 
 //compiler optimizes out unused functions in header
@@ -0,0 +1,116 @@
+#include "v8kernel/SimBodyArena.h"
+#include "v8kernel/SimBody.h"
+#include "util/Debug.h"
+
+namespace RBX {
+
+int SimBodyArena::appendSlot(SimBody* simBody)
+{
+	RBXASSERT(!simBody->arena);
+	RBXASSERT(simBody->arenaIndex == -1);
+
+	int slot = owners.size();
+	owners.append(simBody);
+	position.append(G3D::CoordinateFrame());
+	velocity.append(Velocity());
+	qOrientation.append(Quaternion());
+	angMomentum.append(Vector3::zero());
+	momentRecip.append(Vector3::zero());
+	massRecip.append(0.0f);
+	constantForceY.append(0.0f);
+	force.append(Vector3::zero());
+	torque.append(Vector3::zero());
+	frozen.append(false);
+
+	simBody->arena = this;
+	simBody->arenaIndex = slot;
+	return slot;
+}
+
+void SimBodyArena::removeSlot(SimBody* simBody)
+{
+	RBXASSERT(simBody->arena == this);
+	int slot = simBody->arenaIndex;
+	int last = size() - 1;
+	RBXASSERT(owners[slot] == simBody);
+
+	if (slot != last)
+	{
+		owners[slot] = owners[last];
+		position[slot] = position[last];
+		velocity[slot] = velocity[last];
+		qOrientation[slot] = qOrientation[last];
+		angMomentum[slot] = angMomentum[last];
+		momentRecip[slot] = momentRecip[last];
+		massRecip[slot] = massRecip[last];
+		constantForceY[slot] = constantForceY[last];
+		force[slot] = force[last];
+		torque[slot] = torque[last];
+		frozen[slot] = frozen[last];
+		owners[slot]->arenaIndex = slot;
+	}
+
+	owners.resize(last, false);
+	position.resize(last, false);
+	velocity.resize(last, false);
+	qOrientation.resize(last, false);
+	angMomentum.resize(last, false);
+	momentRecip.resize(last, false);
+	massRecip.resize(last, false);
+	constantForceY.resize(last, false);
+	force.resize(last, false);
+	torque.resize(last, false);
+	frozen.resize(last, false);
+
+	simBody->arena = NULL;
+	simBody->arenaIndex = -1;
+}
+
+void SimBodyArena::insert(SimBody* simBody)
+{
+	appendSlot(simBody);
+}
+
+void SimBodyArena::remove(SimBody* simBody)
+{
+	removeSlot(simBody);
+}
+
+void SimBodyArena::moveTo(SimBody* simBody, SimBodyArena& destination)
+{
+	RBXASSERT(simBody->arena == this);
+	if (&destination == this)
+		return;
+
+	int from = simBody->arenaIndex;
+	G3D::CoordinateFrame _position = position[from];
+	Velocity _velocity = velocity[from];
+	Quaternion _qOrientation = qOrientation[from];
+	G3D::Vector3 _angMomentum = angMomentum[from];
+	G3D::Vector3 _momentRecip = momentRecip[from];
+	float _massRecip = massRecip[from];
+	float _constantForceY = constantForceY[from];
+	G3D::Vector3 _force = force[from];
+	G3D::Vector3 _torque = torque[from];
+
+	removeSlot(simBody);
+	int to = destination.appendSlot(simBody);
+
+	destination.position[to] = _position;
+	destination.velocity[to] = _velocity;
+	destination.qOrientation[to] = _qOrientation;
+	destination.angMomentum[to] = _angMomentum;
+	destination.momentRecip[to] = _momentRecip;
+	destination.massRecip[to] = _massRecip;
+	destination.constantForceY[to] = _constantForceY;
+	destination.force[to] = _force;
+	destination.torque[to] = _torque;
+}
+
+SimBodyArena& SimBodyArena::detached()
+{
+	static SimBodyArena arena(false);
+	return arena;
+}
+
+}
@@ -8,6 +8,7 @@
 #include "v8world/AssemblyStage.h"
 #include "v8world/Assembly.h"
 #include "v8world/Anchor.h"
+#include "v8world/World.h"
 
 namespace RBX
 {
@@ -1183,6 +1184,7 @@ namespace RBX
 		if (p->getAnchorObject())
 			removeAnchor(p->getAnchorObject());
 		removePrimitive(p);
+		RBXASSERT(p->movingIndexFunc() == -1);	// its assembly left SleepStage when the clump was destroyed
 		p->removeFromStage(this);
 	}
 
@@ -1203,6 +1205,7 @@ namespace RBX
 		RBXASSERT(e->getPrimitive(1)->inOrDownstreamOfStage(this));
 
 		Primitive::insertEdge(e);
+		getWorld()->getEdgePairs().insertEdge(e);
 		e->putInStage(this);
 		if (RigidJoint::isRigidJoint(e))
 		{
@@ -1237,6 +1240,7 @@ namespace RBX
 			removeEdge(e);
 		}
 		e->removeFromStage(this);
+		getWorld()->getEdgePairs().removeEdge(e);
 		Primitive::removeEdge(e);
 	}
 
@@ -28,18 +28,14 @@ namespace RBX
 
 	ContactConnector* Contact::createConnector()
 	{
-		ContactConnector* contact = new ContactConnector(this->jointK, this->elasticJointK, this->kFriction);
-		this->getKernel()->insertConnector(contact);
-
-		return contact;
+		return this->getKernel()->newContactConnector(this->jointK, this->elasticJointK, this->kFriction);
 	}
 
 	void Contact::deleteConnector(ContactConnector*& c)
 	{
 		if (c)
 		{
-			this->getKernel()->removeConnector(c);
-			delete c;
+			this->getKernel()->deleteContactConnector(c);
 			c = NULL;
 		}
 	}
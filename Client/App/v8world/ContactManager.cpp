@@ -1,56 +1,338 @@
 #include "v8world/ContactManager.h"
+#include <algorithm>
 #include "v8world/spatialHash.h" // TODO: move these out maybe?
+#include "v8world/DynamicAABBTree.h"
+#include "v8world/SweepAndPrune.h"
 #include "v8world/World.h"
+#include "util/Math.h"
+
+// SSE is available on every x86 target we build for; other targets get the scalar sphere test.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define RBX_SIMD_RAYS
+#include <xmmintrin.h>
+#endif
 
 namespace RBX
 {
-	ContactManager::ContactManager(World* world)
+	// Bounding spheres of a batch's candidates, one array per component and padded to a multiple
+	// of four with spheres no ray can touch.
+	class RaySpheres
 	{
-		SpatialHash* hash = new SpatialHash(world, this);
-		this->spatialHash = hash;
+	public:
+		G3D::Array<float> x, y, z, radiusSquared;
 
+		void set(const G3D::Array<Primitive*>& primitives)
+		{
+			int padded = (primitives.size() + 3) & ~3;
+			x.resize(padded, false);
+			y.resize(padded, false);
+			z.resize(padded, false);
+			radiusSquared.resize(padded, false);
+
+			for (int i = 0; i < padded; i++)
+			{
+				if (i < primitives.size())
+				{
+					const G3D::Vector3& center = primitives[i]->getCoordinateFrame().translation;
+					float radius = primitives[i]->getRadius();
+					x[i] = center.x;
+					y[i] = center.y;
+					z[i] = center.z;
+					radiusSquared[i] = radius * radius;
+				}
+				else
+				{
+					x[i] = y[i] = z[i] = 0.0f;
+					radiusSquared[i] = -1.0f;
+				}
+			}
+		}
+
+		// appends every primitive whose sphere comes within its radius of the segment
+		void cull(const G3D::Array<Primitive*>& primitives, const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& survivors) const
+		{
+			int i = 0;
+#ifdef RBX_SIMD_RAYS
+			const __m128 ox = _mm_set1_ps(unitRay.origin.x);
+			const __m128 oy = _mm_set1_ps(unitRay.origin.y);
+			const __m128 oz = _mm_set1_ps(unitRay.origin.z);
+			const __m128 dx = _mm_set1_ps(unitRay.direction.x);
+			const __m128 dy = _mm_set1_ps(unitRay.direction.y);
+			const __m128 dz = _mm_set1_ps(unitRay.direction.z);
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 end = _mm_set1_ps(maxDistance);
+			for (; i < x.size(); i += 4)
+			{
+				__m128 vx = _mm_sub_ps(_mm_loadu_ps(&x[i]), ox);
+				__m128 vy = _mm_sub_ps(_mm_loadu_ps(&y[i]), oy);
+				__m128 vz = _mm_sub_ps(_mm_loadu_ps(&z[i]), oz);
+				__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+				t = _mm_min_ps(_mm_max_ps(t, zero), end);
+
+				__m128 ex = _mm_sub_ps(vx, _mm_mul_ps(dx, t));
+				__m128 ey = _mm_sub_ps(vy, _mm_mul_ps(dy, t));
+				__m128 ez = _mm_sub_ps(vz, _mm_mul_ps(dz, t));
+				__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+				int bits = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_loadu_ps(&radiusSquared[i])));
+
+				for (int lane = 0; bits; lane++, bits >>= 1)
+				{
+					if (bits & 1)
+						survivors.append(primitives[i + lane]);
+				}
+			}
+#endif
+			for (; i < primitives.size(); i++)
+			{
+				G3D::Vector3 v = G3D::Vector3(x[i], y[i], z[i]) - unitRay.origin;
+				float t = G3D::clamp(v.dot(unitRay.direction), 0.0f, maxDistance);
+				if ((v - unitRay.direction * t).squaredLength() <= radiusSquared[i])
+					survivors.append(primitives[i]);
+			}
+		}
+	};
+
+	ContactManager::ContactManager(World* world)
+	{
 		this->world = world;
+		this->numNewPairs = 0;
+		this->numReleasedPairs = 0;
+		this->spatialHash = NULL;
+		this->broadphaseType = Broadphase::SPATIAL_HASH_BROADPHASE;
+		this->broadphase = newBroadphase(this->broadphaseType);
 	}
 
 	ContactManager::~ContactManager()
 	{
-		delete this->spatialHash;
+		delete this->broadphase;
+	}
+
+	Broadphase* ContactManager::newBroadphase(Broadphase::BroadphaseType type)
+	{
+		switch (type)
+		{
+		case Broadphase::SPATIAL_HASH_BROADPHASE:
+			this->spatialHash = new SpatialHash(world, this);
+			return this->spatialHash;
+		case Broadphase::AABB_TREE_BROADPHASE:
+			this->spatialHash = NULL;
+			return new DynamicAABBTree(world, this);
+		case Broadphase::SWEEP_AND_PRUNE_BROADPHASE:
+			this->spatialHash = NULL;
+			return new SweepAndPrune(world, this);
+		default:
+			RBXASSERT(0);
+			return NULL;
+		}
+	}
+
+	void ContactManager::setBroadphaseType(Broadphase::BroadphaseType type)
+	{
+		if (type == this->broadphaseType)
+			return;
+
+		const G3D::Array<Primitive*>& primitives = this->world->getPrimitives();
+		for (int i = 0; i < primitives.size(); i++)
+		{
+			this->broadphase->onPrimitiveRemoved(primitives[i]);
+		}
+
+		delete this->broadphase;
+		this->broadphaseType = type;
+		this->broadphase = newBroadphase(type);
+
+		for (int i = 0; i < primitives.size(); i++)
+		{
+			this->broadphase->onPrimitiveAdded(primitives[i]);
+		}
+	}
+
+	Contact* ContactManager::createContact(Primitive* p0, Primitive* p1)
+	{
+		// Contacts specialized for a pair of geometry types are picked here from
+		// getGeometryType() and built with newContact so they land in the pool. No pair
+		// has one yet, so every pair gets the general contact.
+		return newContact<Contact>(p0, p1);
+	}
+
+	void ContactManager::deleteContact(Contact* c)
+	{
+		contactPool.destroy(c);
 	}
 
 	void ContactManager::getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& found)
 	{
-		this->spatialHash->getPrimitivesTouchingExtents(extents, ignore, found);
+		this->broadphase->getPrimitivesTouchingExtents(extents, ignore, found);
+	}
+
+	static bool filterKeeps(const HitTestFilter* filter, const Primitive* primitive)
+	{
+		return !filter || filter->filterResult(primitive) != HitTestFilter::IGNORE_PRIM;
+	}
+
+	static bool sphereOverlapsExtents(const G3D::Vector3& center, float radius, const Extents& extents)
+	{
+		G3D::Vector3 closest = center.max(extents.min()).min(extents.max());
+		return (closest - center).squaredLength() <= radius * radius;
+	}
+
+	// separating axis test on the three world and three box axes; the nine edge cross axes are skipped
+	static bool boxOverlapsExtents(const G3D::CoordinateFrame& frame, const G3D::Vector3& halfSize, const Extents& extents)
+	{
+		const G3D::Matrix3& rotation = frame.rotation;
+		G3D::Vector3 half = extents.size() * 0.5f;
+		G3D::Vector3 offset = frame.translation - extents.center();
+
+		for (int i = 0; i < 3; i++)
+		{
+			float boxRadius = fabs(rotation[i][0]) * halfSize.x + fabs(rotation[i][1]) * halfSize.y + fabs(rotation[i][2]) * halfSize.z;
+			if (fabs(offset[i]) > half[i] + boxRadius)
+				return false;
+		}
+
+		for (int j = 0; j < 3; j++)
+		{
+			G3D::Vector3 axis = rotation.getColumn(j);
+			float extentsRadius = fabs(axis.x) * half.x + fabs(axis.y) * half.y + fabs(axis.z) * half.z;
+			if (fabs(offset.dot(axis)) > halfSize[j] + extentsRadius)
+				return false;
+		}
+		return true;
+	}
+
+	// the segment against the extents grown by radius, which lets the rounded corners through
+	static bool capsuleOverlapsExtents(const G3D::Vector3& p0, const G3D::Vector3& p1, float radius, const Extents& extents)
+	{
+		Extents grown(extents.min() - G3D::Vector3(radius, radius, radius), extents.max() + G3D::Vector3(radius, radius, radius));
+		G3D::Vector3 segment = p1 - p0;
+		float length = segment.magnitude();
+		if (length < 1e-6f)
+			return grown.contains(p0);
+
+		return grown.overlapsRay(G3D::Ray::fromOriginAndDirection(p0, segment / length), length);
+	}
+
+	void ContactManager::getPrimitivesTouchingSphere(const G3D::Vector3& center, float radius, const HitTestFilter* filter, G3D::Array<Primitive*>& found)
+	{
+		G3D::Vector3 corner(radius, radius, radius);
+		this->broadphase->getPrimitivesTouchingExtents(Extents(center - corner, center + corner), NULL, found);
+
+		for (int i = found.size() - 1; i >= 0; i--)
+		{
+			if (!sphereOverlapsExtents(center, radius, found[i]->getFastFuzzyExtents()) || !filterKeeps(filter, found[i]))
+				found.fastRemove(i);
+		}
+	}
+
+	void ContactManager::getPrimitivesTouchingBox(const G3D::CoordinateFrame& frame, const G3D::Vector3& halfSize, const HitTestFilter* filter, G3D::Array<Primitive*>& found)
+	{
+		const G3D::Matrix3& rotation = frame.rotation;
+		G3D::Vector3 corner;
+		for (int i = 0; i < 3; i++)
+			corner[i] = fabs(rotation[i][0]) * halfSize.x + fabs(rotation[i][1]) * halfSize.y + fabs(rotation[i][2]) * halfSize.z;
+		this->broadphase->getPrimitivesTouchingExtents(Extents(frame.translation - corner, frame.translation + corner), NULL, found);
+
+		for (int i = found.size() - 1; i >= 0; i--)
+		{
+			if (!boxOverlapsExtents(frame, halfSize, found[i]->getFastFuzzyExtents()) || !filterKeeps(filter, found[i]))
+				found.fastRemove(i);
+		}
+	}
+
+	void ContactManager::getPrimitivesTouchingCapsule(const G3D::Vector3& p0, const G3D::Vector3& p1, float radius, const HitTestFilter* filter, G3D::Array<Primitive*>& found)
+	{
+		G3D::Vector3 corner(radius, radius, radius);
+		this->broadphase->getPrimitivesTouchingExtents(Extents(p0.min(p1) - corner, p0.max(p1) + corner), NULL, found);
+
+		for (int i = found.size() - 1; i >= 0; i--)
+		{
+			if (!capsuleOverlapsExtents(p0, p1, radius, found[i]->getFastFuzzyExtents()) || !filterKeeps(filter, found[i]))
+				found.fastRemove(i);
+		}
+	}
+
+	void ContactManager::getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, const HitTestFilter* filter, G3D::Array<Primitive*>& found)
+	{
+		this->broadphase->getPrimitivesInFrustum(frustum, bounds, found);
+		if (!filter)
+			return;
+
+		// keeps the broadphase's order
+		int kept = 0;
+		for (int i = 0; i < found.size(); i++)
+		{
+			if (filterKeeps(filter, found[i]))
+				found[kept++] = found[i];
+		}
+		found.resize(kept, false);
+	}
+
+	// the hash walks cell rings outward and stops early; the other broadphases sort one box query
+	void ContactManager::getNearestPrimitives(const G3D::Vector3& point, float maxDistance, int maxCount, const HitTestFilter* filter, G3D::Array<Primitive*>& found)
+	{
+		if (spatialHash)
+		{
+			spatialHash->getNearestPrimitives(point, maxDistance, maxCount, filter, found);
+			return;
+		}
+
+		G3D::Vector3 corner(maxDistance, maxDistance, maxDistance);
+		this->broadphase->getPrimitivesTouchingExtents(Extents(point - corner, point + corner), NULL, found);
+
+		G3D::Array<NearbyPrimitive> nearby;
+		float maxDistanceSquared = maxDistance * maxDistance;
+		for (int i = 0; i < found.size(); i++)
+		{
+			float distanceSquared = (found[i]->getCoordinateFrame().translation - point).squaredLength();
+			if (distanceSquared <= maxDistanceSquared && filterKeeps(filter, found[i]))
+			{
+				NearbyPrimitive result = {distanceSquared, found[i]};
+				nearby.append(result);
+			}
+		}
+
+		NearbyPrimitive* first = nearby.getCArray();
+		int count = std::min(maxCount, nearby.size());
+		std::partial_sort(first, first + count, first + nearby.size());
+
+		found.resize(count, false);
+		for (int i = 0; i < count; i++)
+			found[i] = nearby[i].primitive;
 	}
 
 	void ContactManager::onNewPair(Primitive* p0, Primitive* p1)
 	{
 		Contact* contact = this->createContact(p0, p1);
 		this->world->insertContact(contact);
+		this->numNewPairs++;
 	}
 
 	void ContactManager::onReleasePair(Primitive* p0, Primitive* p1)
 	{
 		this->world->destroyContact(Primitive::getContact(p0, p1));
+		this->numReleasedPairs++;
 	}
 
 	void ContactManager::onPrimitiveAdded(Primitive* p)
 	{
-		this->spatialHash->onPrimitiveAdded(p);
+		this->broadphase->onPrimitiveAdded(p);
 	}
 
 	void ContactManager::onPrimitiveRemoved(Primitive* p)
 	{
-		this->spatialHash->onPrimitiveRemoved(p);
+		this->broadphase->onPrimitiveRemoved(p);
 	}
 
 	void ContactManager::onPrimitiveExtentsChanged(Primitive* p)
 	{
-		this->spatialHash->onPrimitiveExtentsChanged(p);
+		this->broadphase->onPrimitiveExtentsChanged(p);
 	}
 
 	void ContactManager::stepWorld()
 	{
-		this->spatialHash->onAllPrimitivesMoved();
+		this->numNewPairs = 0;
+		this->numReleasedPairs = 0;
+		this->broadphase->onAllPrimitivesMoved();
 	}
 
 	bool ContactManager::intersectingOthers(Primitive* check, float overlapIgnored)
@@ -74,6 +356,7 @@ namespace RBX
 
 	bool ContactManager::intersectingOthers(Primitive* check, const std::set<Primitive*>& checkSet, float overlapIgnored)
 	{
+		this->broadphase->flushChanges();
 		for(Contact* cur = check->getFirstContact(); cur != NULL; cur = check->getNextContact(cur))
 		{
 			if(checkSet.find(cur->otherPrimitive(check)) == checkSet.end() && cur->computeIsColliding(overlapIgnored))
@@ -84,6 +367,7 @@ namespace RBX
 
 	void ContactManager::onPrimitiveGeometryTypeChanged(Primitive* p)
 	{
+		this->broadphase->flushChanges();
 		G3D::Array<Contact*> newContacts;
 
 		for(Contact* cur = p->getFirstContact(); cur != NULL; cur = p->getFirstContact())
@@ -126,10 +410,106 @@ namespace RBX
 		return fastHit;
 	}
 
+	// Rays are taken in bundles of raysPerBundle() neighbours. A bundle whose segments fit in a
+	// small box shares one broadphase query and one set of bounding spheres; each ray then culls the
+	// spheres four at a time before anything reaches Primitive::hitTest.
+	void ContactManager::getHits(const G3D::Array<RayQuery>& rays, G3D::Array<RayHit>& hits) const
+	{
+		world->update();
+		hits.resize(rays.size(), false);
+
+		G3D::Array<Primitive*> candidates;
+		G3D::Array<Primitive*> survivors;
+		RaySpheres spheres;
+
+		for (int first = 0; first < rays.size(); first += raysPerBundle())
+		{
+			int end = std::min(first + raysPerBundle(), rays.size());
+
+			Extents bundle;
+			for (int i = first; i < end; i++)
+			{
+				const G3D::Ray& worldRay = rays[i].worldRay;
+				bundle.unionWith(Extents::vv(worldRay.origin, worldRay.origin + worldRay.direction));
+			}
+
+			bool shared = bundle.longestSide() <= maxBundleSize();
+			if (shared)
+			{
+				candidates.fastClear();
+				broadphase->getPrimitivesTouchingExtents(bundle, NULL, candidates);
+				spheres.set(candidates);
+			}
+
+			for (int i = first; i < end; i++)
+			{
+				const RayQuery& query = rays[i];
+				RayHit& hit = hits[i];
+				RBXASSERT(query.worldRay.direction.magnitude() < 5000.0f);
+
+				float maxDistance = std::min(5000.0f, query.worldRay.direction.magnitude());
+				G3D::Ray unitRay = query.worldRay.unit();
+
+				if (!shared)
+				{
+					candidates.fastClear();
+					broadphase->getPrimitivesAlongRay(unitRay, maxDistance, candidates);
+					spheres.set(candidates);
+				}
+
+				survivors.fastClear();
+				spheres.cull(candidates, unitRay, maxDistance, survivors);
+
+				bool stopped;
+				hit.primitive = getSlowHit(survivors, unitRay, query.ignorePrim, query.filter, hit.hitPoint, maxDistance, hit.inside, stopped);
+				if (stopped)
+					hit.primitive = NULL;
+
+				if (hit.primitive)
+				{
+					hit.normal = computeHitNormal(hit.primitive, hit.hitPoint);
+				}
+				else
+				{
+					hit.hitPoint = G3D::Vector3::zero();
+					hit.normal = G3D::Vector3::zero();
+					hit.inside = false;
+				}
+			}
+		}
+	}
+
+	// balls are normal along the radius, everything else is treated as its box and takes the face
+	// the hit point is relatively closest to
+	G3D::Vector3 ContactManager::computeHitNormal(const Primitive* primitive, const G3D::Vector3& hitPoint)
+	{
+		const G3D::CoordinateFrame& frame = primitive->getCoordinateFrame();
+		G3D::Vector3 local = frame.pointToObjectSpace(hitPoint);
+
+		if (primitive->getGeometry()->getGeometryType() == Geometry::GEOMETRY_BALL)
+			return frame.vectorToWorldSpace(local.direction());
+
+		G3D::Vector3 halfSize = primitive->getGridSize() * 0.5f;
+		int axis = 0;
+		float best = -1.0f;
+		for (int i = 0; i < 3; i++)
+		{
+			float relative = halfSize[i] > 0.0f ? fabs(local[i]) / halfSize[i] : 0.0f;
+			if (relative > best)
+			{
+				best = relative;
+				axis = i;
+			}
+		}
+
+		G3D::Vector3 normal = G3D::Vector3::zero();
+		normal[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+		return frame.vectorToWorldSpace(normal);
+	}
+
 	Primitive* ContactManager::getFastHit(const G3D::Ray& worldRay, const G3D::Array<Primitive const*>* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPointWorld, bool& inside, bool& stopped) const
 	{
 		G3D::Array<Primitive*> primitives;
-		Vector3int32 grid = SpatialHash::realToHashGrid(worldRay.origin);
 		float magnitude = worldRay.direction.magnitude();
 
 		RBXASSERT(magnitude < 5000.0f);
@@ -138,22 +518,56 @@ namespace RBX
 
 		G3D::Ray unitRay = worldRay.unit();
 
+		// the hash walks its cells front to back and can stop at the first cell with a hit
+		if (!spatialHash)
+		{
+			broadphase->getPrimitivesAlongRay(unitRay, magnitude, primitives);
+			return getSlowHit(primitives, unitRay, ignorePrim, filter, hitPointWorld, magnitude, inside, stopped);
+		}
+
+		// a hit found in one cell may lie in a later one; it is kept until the walk has covered
+		// everything in front of it
+		Primitive* bestHit = NULL;
+		float bestDistance = Math::inf();
+		G3D::Vector3 bestPoint;
+		bool bestInside = false;
+		bool bestStopped = false;
+
+		SpatialHash::RayWalk walk(unitRay, magnitude);
 		do
 		{
 			primitives.fastClear();
-			spatialHash->getPrimitivesInGrid(grid, primitives);
-			Primitive* slowHit = getSlowHit(primitives, unitRay, ignorePrim, filter, hitPointWorld, magnitude, inside, stopped);
+			spatialHash->getPrimitivesInGrid(walk.getGrid(), primitives);
 
-			if(slowHit)
+			G3D::Vector3 cellPoint;
+			bool cellInside;
+			bool cellStopped;
+			Primitive* slowHit = getSlowHit(primitives, unitRay, ignorePrim, filter, cellPoint, magnitude, cellInside, cellStopped);
+			if (slowHit)
 			{
-				Extents hashGrid = SpatialHash::hashGridToRealExtents(grid.toVector3());
-				if(hashGrid.fuzzyContains(hitPointWorld, 0.001f))
-					return slowHit;
+				float distance = unitRay.direction.dot(cellPoint - unitRay.origin);
+				if (distance < bestDistance)
+				{
+					bestHit = slowHit;
+					bestDistance = distance;
+					bestPoint = cellPoint;
+					bestInside = cellInside;
+					bestStopped = cellStopped;
+				}
 			}
+
+			if (bestHit && bestDistance <= walk.getExitDistance() + 0.001f)
+				break;
 		}
-		while(spatialHash->getNextGrid(grid, unitRay, magnitude));
+		while (walk.next());
 
-		return NULL;
+		stopped = bestStopped;
+		if (bestHit)
+		{
+			hitPointWorld = bestPoint;
+			inside = bestInside;
+		}
+		return bestHit;
 	}
 
 	Primitive* ContactManager::getHitLegacy(const G3D::Ray& originDirection, const Primitive* ignorePrim, const HitTestFilter* filter, G3D::Vector3& hitPointWorld, float& distanceToHit, const float& maxSearchDepth) const
@@ -252,4 +666,4 @@ namespace RBX
 		return bestPrimitive;
 	}
 
-}
\ No newline at end of file
+}
\ No newline at end of file
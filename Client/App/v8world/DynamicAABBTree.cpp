@@ -0,0 +1,498 @@
+#include "v8world/DynamicAABBTree.h"
+#include "v8world/Primitive.h"
+#include "v8world/ContactManager.h"
+#include "v8world/World.h"
+#include "v8world/Assembly.h"
+#include "util/Debug.h"
+
+namespace RBX
+{
+	DynamicAABBTree::DynamicAABBTree(World* world, ContactManager* contactManager)
+		: world(world),
+		  contactManager(contactManager),
+		  root(-1),
+		  freeList(-1),
+		  nodesOut(0)
+	{
+	}
+
+	DynamicAABBTree::~DynamicAABBTree()
+	{
+		RBXASSERT(nodesOut == 0);
+	}
+
+	float DynamicAABBTree::surfaceArea(const Extents& box)
+	{
+		Vector3 size = box.size();
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	Extents DynamicAABBTree::combine(const Extents& a, const Extents& b)
+	{
+		Extents answer(a);
+		answer.unionWith(b);
+		return answer;
+	}
+
+	int DynamicAABBTree::allocateNode()
+	{
+		if (freeList == -1)
+		{
+			int first = nodes.size();
+			int newSize = std::max(16, first * 2);
+			nodes.resize(newSize);
+			for (int i = first; i < newSize; i++)
+			{
+				nodes[i].parent = (i + 1 < newSize) ? i + 1 : -1;
+				nodes[i].height = -1;
+			}
+			freeList = first;
+		}
+
+		int index = freeList;
+		Node& node = nodes[index];
+		freeList = node.parent;
+		node.primitive = NULL;
+		node.parent = -1;
+		node.child0 = -1;
+		node.child1 = -1;
+		node.height = 0;
+		nodesOut++;
+		return index;
+	}
+
+	void DynamicAABBTree::freeNode(int index)
+	{
+		RBXASSERT(nodes[index].height >= 0);
+		nodes[index].primitive = NULL;
+		nodes[index].parent = freeList;
+		nodes[index].height = -1;
+		freeList = index;
+		nodesOut--;
+	}
+
+	// walks down picking the sibling that adds the least surface area to the tree
+	void DynamicAABBTree::insertLeaf(int leaf)
+	{
+		if (root == -1)
+		{
+			root = leaf;
+			nodes[root].parent = -1;
+			return;
+		}
+
+		Extents leafBox = nodes[leaf].box;
+		int index = root;
+		while (!nodes[index].isLeaf())
+		{
+			const Node& node = nodes[index];
+			float area = surfaceArea(node.box);
+			float combinedArea = surfaceArea(combine(node.box, leafBox));
+
+			// cost of making a new parent for this node and the leaf
+			float cost = 2.0f * combinedArea;
+			// cost of pushing the leaf further down
+			float inheritanceCost = 2.0f * (combinedArea - area);
+
+			float childCost[2];
+			int children[2] = {node.child0, node.child1};
+			for (int i = 0; i < 2; i++)
+			{
+				const Node& child = nodes[children[i]];
+				float grownArea = surfaceArea(combine(child.box, leafBox));
+				childCost[i] = child.isLeaf()
+					? grownArea + inheritanceCost
+					: grownArea - surfaceArea(child.box) + inheritanceCost;
+			}
+
+			if (cost < childCost[0] && cost < childCost[1])
+				break;
+
+			index = (childCost[0] < childCost[1]) ? children[0] : children[1];
+		}
+
+		int sibling = index;
+		int oldParent = nodes[sibling].parent;
+		int newParent = allocateNode();		// may grow nodes - no references held across this
+
+		nodes[newParent].parent = oldParent;
+		nodes[newParent].box = combine(leafBox, nodes[sibling].box);
+		nodes[newParent].height = nodes[sibling].height + 1;
+		nodes[newParent].child0 = sibling;
+		nodes[newParent].child1 = leaf;
+		nodes[sibling].parent = newParent;
+		nodes[leaf].parent = newParent;
+
+		if (oldParent == -1)
+		{
+			root = newParent;
+		}
+		else if (nodes[oldParent].child0 == sibling)
+		{
+			nodes[oldParent].child0 = newParent;
+		}
+		else
+		{
+			nodes[oldParent].child1 = newParent;
+		}
+
+		refitAncestors(newParent);
+	}
+
+	void DynamicAABBTree::removeLeaf(int leaf)
+	{
+		if (leaf == root)
+		{
+			root = -1;
+			return;
+		}
+
+		int parent = nodes[leaf].parent;
+		int grandParent = nodes[parent].parent;
+		int sibling = (nodes[parent].child0 == leaf) ? nodes[parent].child1 : nodes[parent].child0;
+
+		if (grandParent == -1)
+		{
+			root = sibling;
+			nodes[sibling].parent = -1;
+			freeNode(parent);
+			return;
+		}
+
+		if (nodes[grandParent].child0 == parent)
+			nodes[grandParent].child0 = sibling;
+		else
+			nodes[grandParent].child1 = sibling;
+
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+		refitAncestors(grandParent);
+	}
+
+	void DynamicAABBTree::refitAncestors(int index)
+	{
+		while (index != -1)
+		{
+			index = balance(index);
+
+			Node& node = nodes[index];
+			const Node& child0 = nodes[node.child0];
+			const Node& child1 = nodes[node.child1];
+			node.height = 1 + std::max(child0.height, child1.height);
+			node.box = combine(child0.box, child1.box);
+
+			index = node.parent;
+		}
+	}
+
+	// if one child of a is more than one level taller, rotate it up into a's place; returns the subtree root
+	int DynamicAABBTree::balance(int iA)
+	{
+		Node& a = nodes[iA];
+		if (a.isLeaf() || a.height < 2)
+			return iA;
+
+		int iB = a.child0;
+		int iC = a.child1;
+		Node& b = nodes[iB];
+		Node& c = nodes[iC];
+		int heightDifference = c.height - b.height;
+
+		if (heightDifference > 1)
+		{
+			// rotate c up
+			int iF = c.child0;
+			int iG = c.child1;
+			Node& f = nodes[iF];
+			Node& g = nodes[iG];
+
+			c.child0 = iA;
+			c.parent = a.parent;
+			a.parent = iC;
+
+			if (c.parent == -1)
+				root = iC;
+			else if (nodes[c.parent].child0 == iA)
+				nodes[c.parent].child0 = iC;
+			else
+				nodes[c.parent].child1 = iC;
+
+			if (f.height > g.height)
+			{
+				c.child1 = iF;
+				a.child1 = iG;
+				g.parent = iA;
+				a.box = combine(b.box, g.box);
+				c.box = combine(a.box, f.box);
+				a.height = 1 + std::max(b.height, g.height);
+				c.height = 1 + std::max(a.height, f.height);
+			}
+			else
+			{
+				c.child1 = iG;
+				a.child1 = iF;
+				f.parent = iA;
+				a.box = combine(b.box, f.box);
+				c.box = combine(a.box, g.box);
+				a.height = 1 + std::max(b.height, f.height);
+				c.height = 1 + std::max(a.height, g.height);
+			}
+			return iC;
+		}
+
+		if (heightDifference < -1)
+		{
+			// rotate b up
+			int iD = b.child0;
+			int iE = b.child1;
+			Node& d = nodes[iD];
+			Node& e = nodes[iE];
+
+			b.child0 = iA;
+			b.parent = a.parent;
+			a.parent = iB;
+
+			if (b.parent == -1)
+				root = iB;
+			else if (nodes[b.parent].child0 == iA)
+				nodes[b.parent].child0 = iB;
+			else
+				nodes[b.parent].child1 = iB;
+
+			if (d.height > e.height)
+			{
+				b.child1 = iD;
+				a.child0 = iE;
+				e.parent = iA;
+				a.box = combine(c.box, e.box);
+				b.box = combine(a.box, d.box);
+				a.height = 1 + std::max(c.height, e.height);
+				b.height = 1 + std::max(a.height, d.height);
+			}
+			else
+			{
+				b.child1 = iE;
+				a.child0 = iD;
+				d.parent = iA;
+				a.box = combine(c.box, d.box);
+				b.box = combine(a.box, e.box);
+				a.height = 1 + std::max(c.height, d.height);
+				b.height = 1 + std::max(a.height, e.height);
+			}
+			return iB;
+		}
+
+		return iA;
+	}
+
+	// returns true if the primitive's fat box was rebuilt and reinserted, see Primitive::updateFatExtents
+	bool DynamicAABBTree::refreshLeaf(Primitive* p, bool& shrunk)
+	{
+		int leaf = p->broadphaseIndexFunc();
+		RBXASSERT(leaf >= 0);
+
+		if (!p->updateFatExtents(shrunk))
+			return false;
+
+		removeLeaf(leaf);
+		nodes[leaf].box = p->getFatExtents();
+		insertLeaf(leaf);
+		return true;
+	}
+
+	void DynamicAABBTree::releaseSeparatedPairs(Primitive* p)
+	{
+		const Extents& box = nodes[p->broadphaseIndexFunc()].box;
+
+		Contact* next;
+		for (Contact* contact = p->getFirstContact(); contact != NULL; contact = next)
+		{
+			next = p->getNextContact(contact);
+			Primitive* other = contact->otherPrimitive(p);
+			if (!box.overlapsOrTouches(nodes[other->broadphaseIndexFunc()].box))
+				contactManager->onReleasePair(p, other);
+		}
+	}
+
+	void DynamicAABBTree::findNewPairs(Primitive* p)
+	{
+		// collect first - creating a contact must not run while the traversal stack is in use
+		touching.fastClear();
+		queryFatBoxes(nodes[p->broadphaseIndexFunc()].box, p, touching);
+
+		for (int i = 0; i < touching.size(); i++)
+		{
+			if (!Primitive::getContact(p, touching[i]))
+				contactManager->onNewPair(p, touching[i]);
+		}
+	}
+
+	void DynamicAABBTree::onPrimitiveAdded(Primitive* p)
+	{
+		RBXASSERT(p->broadphaseIndexFunc() == -1);
+
+		int leaf = allocateNode();
+		p->updateFatExtents();
+		nodes[leaf].box = p->getFatExtents();
+		nodes[leaf].primitive = p;
+		p->broadphaseIndexFunc() = leaf;
+		insertLeaf(leaf);
+
+		findNewPairs(p);
+	}
+
+	void DynamicAABBTree::onPrimitiveRemoved(Primitive* p)
+	{
+		int leaf = p->broadphaseIndexFunc();
+		RBXASSERT(leaf >= 0);
+
+		while (Contact* contact = p->getFirstContact())
+			contactManager->onReleasePair(p, contact->otherPrimitive(p));
+
+		removeLeaf(leaf);
+		freeNode(leaf);
+		p->broadphaseIndexFunc() = -1;
+	}
+
+	void DynamicAABBTree::onPrimitiveExtentsChanged(Primitive* p)
+	{
+		bool shrunk;
+		if (refreshLeaf(p, shrunk))
+		{
+			releaseSeparatedPairs(p);
+			findNewPairs(p);
+		}
+	}
+
+	// refit everything first, so pairs are judged against this step's boxes
+	void DynamicAABBTree::onAllPrimitivesMoved()
+	{
+		moved.fastClear();
+		numFatExtentsKept = 0;
+		numFatExtentsShrunk = 0;
+
+		const G3D::Array<Primitive*>& primitives = this->world->getMovingPrimitives();
+		for (int i = 0; i < primitives.size(); i++)
+		{
+			Primitive* primitive = primitives[i];
+			RBXASSERT(primitive->getAssembly()->moving());
+			bool shrunk;
+			if (refreshLeaf(primitive, shrunk))
+			{
+				moved.append(primitive);
+				if (shrunk)
+					numFatExtentsShrunk++;
+			}
+			else
+				numFatExtentsKept++;
+		}
+
+		for (int i = 0; i < moved.size(); i++)
+		{
+			releaseSeparatedPairs(moved[i]);
+			findNewPairs(moved[i]);
+		}
+	}
+
+	void DynamicAABBTree::queryFatBoxes(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer)
+	{
+		if (root == -1)
+			return;
+
+		stack.fastClear();
+		stack.append(root);
+		while (stack.size() > 0)
+		{
+			const Node& node = nodes[stack.pop()];
+			if (!node.box.overlapsOrTouches(extents))
+				continue;
+
+			if (node.isLeaf())
+			{
+				if (node.primitive != ignore)
+					answer.append(node.primitive);
+			}
+			else
+			{
+				stack.append(node.child0);
+				stack.append(node.child1);
+			}
+		}
+	}
+
+	void DynamicAABBTree::getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(answer.size() == 0);
+		queryFatBoxes(extents, ignore, answer);
+
+		for (int i = answer.size() - 1; i >= 0; i--)
+		{
+			if (!extents.overlapsOrTouches(answer[i]->getFastFuzzyExtents()))
+				answer.fastRemove(i);
+		}
+	}
+
+	// A subtree whose box is fully inside is pushed as ~index and taken whole. A leaf's fat box holds
+	// the fuzzy extents, so only partly covered leaves need testing against the primitive itself.
+	void DynamicAABBTree::getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(answer.size() == 0);
+		if (root == -1)
+			return;
+
+		stack.fastClear();
+		stack.append(root);
+		while (stack.size() > 0)
+		{
+			int index = stack.pop();
+			bool inside = index < 0;
+			const Node& node = nodes[inside ? ~index : index];
+
+			if (!inside)
+			{
+				Containment containment = cullExtents(node.box, frustum, bounds);
+				if (containment == OUTSIDE)
+					continue;
+				inside = (containment == INSIDE);
+			}
+
+			if (node.isLeaf())
+			{
+				if (inside || cullExtents(node.primitive->getFastFuzzyExtents(), frustum, bounds) != OUTSIDE)
+					answer.append(node.primitive);
+			}
+			else
+			{
+				stack.append(inside ? ~node.child1 : node.child1);
+				stack.append(inside ? ~node.child0 : node.child0);
+			}
+		}
+	}
+
+	void DynamicAABBTree::getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(answer.size() == 0);
+		RBXASSERT(unitRay.direction.isUnit());
+		if (root == -1)
+			return;
+
+		stack.fastClear();
+		stack.append(root);
+		while (stack.size() > 0)
+		{
+			const Node& node = nodes[stack.pop()];
+			if (!node.box.overlapsRay(unitRay, maxDistance))
+				continue;
+
+			if (node.isLeaf())
+			{
+				answer.append(node.primitive);
+			}
+			else
+			{
+				stack.append(node.child0);
+				stack.append(node.child1);
+			}
+		}
+	}
+}
@@ -0,0 +1,171 @@
+#include "v8world/EdgePairTable.h"
+#include <algorithm>
+#include "v8world/Primitive.h"
+#include "v8world/Contact.h"
+#include "v8world/Joint.h"
+#include "util/Debug.h"
+
+namespace RBX
+{
+	EdgePairTable::EdgePairTable()
+		: numPairs(0)
+	{
+		Slot empty = {NULL, NULL, NULL, NULL, 0};
+		slots.assign(minSlots(), empty);
+	}
+
+	// pointers are at least 8 byte aligned, so the low bits carry nothing
+	unsigned int EdgePairTable::hash(const Primitive* p0, const Primitive* p1)
+	{
+		unsigned int h = static_cast<unsigned int>(reinterpret_cast<size_t>(p0) >> 3) * 0x9e3779b1u;
+		h ^= static_cast<unsigned int>(reinterpret_cast<size_t>(p1) >> 3) * 0x85ebca6bu;
+		h ^= h >> 16;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 13;
+		return h;
+	}
+
+	int EdgePairTable::find(const Primitive* p0, const Primitive* p1) const
+	{
+		if (p1 < p0)
+			std::swap(p0, p1);
+
+		size_t mask = slots.size() - 1;
+		for (size_t i = hash(p0, p1) & mask; slots[i].p0; i = (i + 1) & mask)
+		{
+			if (slots[i].p0 == p0 && slots[i].p1 == p1)
+				return static_cast<int>(i);
+		}
+		return -1;
+	}
+
+	int EdgePairTable::findOrAdd(Primitive* p0, Primitive* p1)
+	{
+		if (p1 < p0)
+			std::swap(p0, p1);
+
+		// at most half full, so probes stay short
+		if (2 * (numPairs + 1) > static_cast<int>(slots.size()))
+			resize(2 * slots.size());
+
+		size_t mask = slots.size() - 1;
+		size_t i = hash(p0, p1) & mask;
+		for (; slots[i].p0; i = (i + 1) & mask)
+		{
+			if (slots[i].p0 == p0 && slots[i].p1 == p1)
+				return static_cast<int>(i);
+		}
+
+		Slot added = {p0, p1, NULL, NULL, 0};
+		slots[i] = added;
+		numPairs++;
+		return static_cast<int>(i);
+	}
+
+	// Backward shift deletion: later entries of the probe run move into the hole unless their home
+	// slot lies cyclically after it, so lookups never need tombstones.
+	void EdgePairTable::removeAt(int index)
+	{
+		size_t mask = slots.size() - 1;
+		size_t hole = index;
+		for (size_t i = (hole + 1) & mask; slots[i].p0; i = (i + 1) & mask)
+		{
+			size_t home = hash(slots[i].p0, slots[i].p1) & mask;
+			bool homeAfterHole = (i > hole) ? (home > hole && home <= i) : (home > hole || home <= i);
+			if (!homeAfterHole)
+			{
+				slots[hole] = slots[i];
+				hole = i;
+			}
+		}
+
+		slots[hole].p0 = NULL;
+		numPairs--;
+	}
+
+	void EdgePairTable::resize(size_t newSize)
+	{
+		std::vector<Slot> old;
+		old.swap(slots);
+
+		Slot empty = {NULL, NULL, NULL, NULL, 0};
+		slots.assign(newSize, empty);
+
+		size_t mask = newSize - 1;
+		for (size_t i = 0; i < old.size(); i++)
+		{
+			if (!old[i].p0)
+				continue;
+
+			size_t j = hash(old[i].p0, old[i].p1) & mask;
+			while (slots[j].p0)
+				j = (j + 1) & mask;
+			slots[j] = old[i];
+		}
+	}
+
+	void EdgePairTable::insertEdge(Edge* e)
+	{
+		Slot& slot = slots[findOrAdd(e->getPrimitive(0), e->getPrimitive(1))];
+		if (e->getEdgeType() == Edge::CONTACT)
+		{
+			RBXASSERT(!slot.contact);
+			slot.contact = rbx_static_cast<Contact*>(e);
+		}
+		else
+		{
+			if (!slot.joint)
+				slot.joint = rbx_static_cast<Joint*>(e);
+			slot.numJoints++;
+		}
+	}
+
+	// call while e is still in its primitives' edge lists, another joint of the pair may replace it
+	void EdgePairTable::removeEdge(Edge* e)
+	{
+		Primitive* p0 = e->getPrimitive(0);
+		Primitive* p1 = e->getPrimitive(1);
+		int index = find(p0, p1);
+		RBXASSERT(index != -1);
+
+		Slot& slot = slots[index];
+		if (e->getEdgeType() == Edge::CONTACT)
+		{
+			RBXASSERT(slot.contact == e);
+			slot.contact = NULL;
+		}
+		else
+		{
+			RBXASSERT(slot.numJoints > 0);
+			slot.numJoints--;
+			if (slot.joint == e)
+			{
+				slot.joint = NULL;
+				for (Joint* j = p0->getFirstJoint(); j && slot.numJoints > 0; j = p0->getNextJoint(j))
+				{
+					if (j != e && j->links(p0, p1))
+					{
+						slot.joint = j;
+						break;
+					}
+				}
+				RBXASSERT((slot.joint != NULL) == (slot.numJoints > 0));
+			}
+		}
+
+		if (!slot.contact && slot.numJoints == 0)
+			removeAt(index);
+	}
+
+	Contact* EdgePairTable::getContact(const Primitive* p0, const Primitive* p1) const
+	{
+		int index = find(p0, p1);
+		return index == -1 ? NULL : slots[index].contact;
+	}
+
+	Joint* EdgePairTable::getJoint(const Primitive* p0, const Primitive* p1) const
+	{
+		int index = find(p0, p1);
+		return index == -1 ? NULL : slots[index].joint;
+	}
+}
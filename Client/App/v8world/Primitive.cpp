@@ -8,13 +8,21 @@
 
 namespace RBX 
 {
+	float Primitive::fatExtentsMargin = 0.5f;
+	float Primitive::fatExtentsLookahead = 0.05f;
+	float Primitive::fatExtentsSlack = 2.0f;
+	bool Primitive::ignoreBool = false;
+
 	#pragma warning (push)
 	#pragma warning (disable : 4355) // warning C4355: 'this' : used in base member initializer list
 	Primitive::Primitive(Geometry::GeometryType geometryType) :
 		guidSetExternally(false),
 		world(NULL),
 		clump(NULL),
-		spatialNodes(NULL),
+		spatialNodes(-1),
+		spatialLevel(-1),
+		broadphaseIndex(-1),
+		movingIndex(-1),
 		worldIndex(-1),
 		clumpDepth(-1),
 		traverseId(-1),
@@ -206,6 +214,45 @@ namespace RBX
 		return rbx_static_cast<Contact*>(contacts.first);
 	}
 
+	// The fat extents are only rebuilt once the fuzzy extents leave them, so a part jittering in place
+	// keeps the same broadphase cells and pairs. Rebuilding grows them by fatExtentsMargin and stretches
+	// them fatExtentsLookahead seconds along the linear velocity. A part that slows down or comes to
+	// rest would keep the box it was given at speed, so they are also rebuilt, setting shrunk, once they
+	// hold more than fatExtentsSlack times the volume a rebuild would give. Returns true if they were rebuilt.
+	bool Primitive::updateFatExtents(bool& shrunk)
+	{
+		const Extents& fuzzy = getFastFuzzyExtents();
+		G3D::Vector3 margin(fatExtentsMargin, fatExtentsMargin, fatExtentsMargin);
+		G3D::Vector3 ahead = body->getVelocity().linear * fatExtentsLookahead;
+		Extents rebuilt(
+			fuzzy.min() - margin + ahead.min(G3D::Vector3::zero()),
+			fuzzy.max() + margin + ahead.max(G3D::Vector3::zero()));
+
+		shrunk = false;
+		if (fatExtents.contains(fuzzy))
+		{
+			if (fatExtents.volume() <= fatExtentsSlack * rebuilt.volume())
+				return false;
+			shrunk = true;
+		}
+
+		fatExtents = rebuilt;
+		return true;
+	}
+
+	// both edges are found through the world's pair table rather than the edge lists
+	Joint* Primitive::getJoint(Primitive* p0, Primitive* p1)
+	{
+		World* world = p0->getWorld();
+		return world ? world->getEdgePairs().getJoint(p0, p1) : NULL;
+	}
+
+	Contact* Primitive::getContact(Primitive* p0, Primitive* p1)
+	{
+		World* world = p0->getWorld();
+		return world ? world->getEdgePairs().getContact(p0, p1) : NULL;
+	}
+
 	RigidJoint* Primitive::getFirstRigid()
 	{
 		return getFirstRigidAt(getFirstEdge());
@@ -398,6 +445,7 @@ namespace RBX
 		if(protectedSize != geometry->getGridSize())
 		{
 			fuzzyExtentsStateId = -2;
+			fatExtents = Extents();
 			geometry->setGridSize(protectedSize);
 
 			float newSize = geometry->getGridVolume();
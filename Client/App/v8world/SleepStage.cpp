@@ -4,6 +4,7 @@
 #include "v8world/Primitive.h"
 #include "v8world/SeparateStage.h"
 #include "v8world/CollisionStage.h"
+#include "v8world/World.h"
 
 namespace RBX
 {
@@ -63,6 +64,7 @@ namespace RBX
 		{
 			RBXASSERT(assembly->downstreamOfStage(this));
 			rbx_static_cast<SeparateStage*>(getDownstreamWS())->onAssemblyRemoving(assembly);
+			getWorld()->onAssemblyStoppedMoving(assembly);
 		}
 
 		RBXASSERT(assembly->inStage(this));
@@ -89,6 +91,7 @@ namespace RBX
 		if (assembly->getSleepStatus() == Sim::AWAKE)
 		{
 			rbx_static_cast<SeparateStage*>(getDownstreamWS())->onAssemblyAdded(assembly);
+			getWorld()->onAssemblyStartedMoving(assembly);
 		}
 	}
 
@@ -1,63 +1,191 @@
 #include "v8world/SpatialHash.h"
+#include <algorithm>
 #include "v8world/Primitive.h"
+#include "v8world/Contact.h"
 #include "v8world/ContactManager.h"
 #include "v8world/World.h"
 #include "v8world/Assembly.h"
+#include "v8kernel/Kernel.h"
+#include "util/Math.h"
 #include "util/debug.h"
 
 namespace RBX
 {
-	size_t SpatialHash::numBuckets()
-	{
-		return 0x10000;
-	}
-
 	SpatialHash::SpatialHash(World* world, ContactManager* contactManager) 
 		:world(world), 
 		contactManager(contactManager), 
-		extraNodes(0), 
+		buckets(minBuckets(), -1),
+		rehashCursor(0),
+		numRehashes(0),
+		traverseStamp(0),
+		freeNodes(-1), 
 		nodesOut(0), 
-		maxBucket(0)
+		maxBucket(0),
+		primitivesAtLevel(numLevels(), 0)
 	{
-		std::vector<SpatialNode*> temp(numBuckets());
-		this->nodes.swap(temp);
 	}
 
 	SpatialHash::~SpatialHash()
 	{
-		RBXASSERT(this->nodes.size() == numBuckets());
+		for (size_t i = 0; i < this->buckets.size(); i++)
+		{
+			for (int index = this->buckets[i]; index != -1; index = node(index).nextHashLink)
+				this->nodesOut--;
+		}
+
+		for (size_t i = this->rehashCursor; i < this->oldBuckets.size(); i++)
+		{
+			for (int index = this->oldBuckets[i]; index != -1; index = node(index).nextHashLink)
+				this->nodesOut--;
+		}
+
+		for (size_t i = 0; i < this->slabs.size(); i++)
+			delete this->slabs[i];
 
-		for (size_t i = 0; i < numBuckets(); i++)
+		for (int i = 0; i < this->moveTasks.size(); i++)
+			delete this->moveTasks[i];
+
+		RBXASSERT(this->nodesOut == 0);
+	}
+
+	// a new slab is threaded onto the free list lowest index first, so nodes added together sit together
+	int SpatialHash::newNode()
+	{
+		if (this->freeNodes == -1)
 		{
-			if (this->nodes[i])
+			NodeSlab* slab = new NodeSlab();
+			int first = static_cast<int>(this->slabs.size()) << NODE_SLAB_SHIFT;
+			this->slabs.push_back(slab);
+			for (int i = NODE_SLAB_SIZE - 1; i >= 0; i--)
 			{
-				while(this->nodes[i])
-				{
-					SpatialNode* backup = this->nodes[i];
-					this->nodes[i] = this->nodes[i]->nextHashLink;
-					delete backup;
-					this->nodesOut--;
-				}
+				slab->nodes[i].nextHashLink = this->freeNodes;
+				this->freeNodes = first + i;
 			}
 		}
 
-		while(this->extraNodes)
+		int index = this->freeNodes;
+		this->freeNodes = node(index).nextHashLink;
+		++this->nodesOut;
+		return index;
+	}
+
+	void SpatialHash::returnNode(int index)
+	{
+		node(index).primitive = NULL;
+		node(index).nextHashLink = this->freeNodes;
+		this->freeNodes = index;
+		--this->nodesOut;
+	}
+
+	// Full 32 bit hash - the table masks off as many low bits as it has buckets, so every input bit
+	// has to reach the low bits. Multiplies spread each coordinate, the murmur3 finalizer mixes them.
+	// A cell's shadows get their own chain; a coarse cell can shadow thousands of small primitives.
+	unsigned int SpatialHash::getHash(const Vector3int32& grid, int level, bool shadow)
+	{
+		unsigned int h = static_cast<unsigned int>(grid.x) * 0x8da6b343u;
+		h ^= static_cast<unsigned int>(grid.y) * 0xd8163841u;
+		h ^= static_cast<unsigned int>(grid.z) * 0xcb1ab31fu;
+		h ^= static_cast<unsigned int>(2 * level + (shadow ? 1 : 0)) * 0x165667b1u;
+
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// The chains a cell's nodes can be in: its bucket in the old table if that hasn't been moved yet,
+	// then its bucket in the current one. Returns how many heads were written.
+	int SpatialHash::cellChains(unsigned int hash, int* heads) const
+	{
+		int numChains = 0;
+		if (isRehashing())
 		{
-			SpatialNode* node = this->extraNodes;
-			this->extraNodes = node->nextHashLink;
-			delete node;
+			size_t oldBucket = hash & (this->oldBuckets.size() - 1);
+			if (oldBucket >= this->rehashCursor)
+				heads[numChains++] = this->oldBuckets[oldBucket];
 		}
+		heads[numChains++] = this->buckets[hash & (this->buckets.size() - 1)];
+		return numChains;
+	}
 
-		RBXASSERT(this->nodesOut == 0);
+	void SpatialHash::rehashStep(int numOldBuckets)
+	{
+		size_t mask = this->buckets.size() - 1;
+		for (int i = 0; i < numOldBuckets && isRehashing(); i++)
+		{
+			int index = this->oldBuckets[this->rehashCursor];
+			while (index != -1)
+			{
+				SpatialNode& moving = node(index);
+				int next = moving.nextHashLink;
+				int& head = this->buckets[getHash(moving.gridId, moving.level, moving.shadow) & mask];
+				if (head != -1)
+					links(head).prevHashLink = index;
+				moving.nextHashLink = head;
+				links(index).prevHashLink = -1;
+				head = index;
+				index = next;
+			}
+			this->oldBuckets[this->rehashCursor] = -1;
+
+			if (++this->rehashCursor == this->oldBuckets.size())
+			{
+				std::vector<int>().swap(this->oldBuckets);
+				this->rehashCursor = 0;
+			}
+		}
+	}
+
+	// Doubles or halves the table once the load leaves [minLoadFactor, maxLoadFactor]. The old table
+	// is then drained a few buckets at a time rather than in one long stall.
+	void SpatialHash::checkLoad()
+	{
+		if (isRehashing())
+			return;
+
+		size_t size = this->buckets.size();
+		size_t newSize = size;
+		if (this->nodesOut > maxLoadFactor() * size)
+			newSize = size * 2;
+		else if (size > minBuckets() && this->nodesOut < minLoadFactor() * size)
+			newSize = size / 2;
+
+		if (newSize != size)
+		{
+			this->oldBuckets.swap(this->buckets);
+			this->buckets.assign(newSize, -1);
+			this->rehashCursor = 0;
+			this->numRehashes++;
+			this->maxBucket = 0;
+		}
 	}
 
-	int SpatialHash::getHash(const Vector3int32& grid)
+	void SpatialHash::doStats(Stats& stats) const
 	{
-		int result = grid.x * -0xba3 ^ grid.y * 0x409f ^ grid.z * -0x49;
-		result &= (numBuckets()-1);
-		RBXASSERT(result >= 0);
-		RBXASSERT(result < (int)numBuckets());
-		return result;
+		stats.numBuckets = getNumBuckets();
+		stats.numNodes = this->nodesOut;
+		stats.loadFactor = static_cast<float>(this->nodesOut) / this->buckets.size();
+		stats.longestChain = 0;
+		stats.numRehashes = this->numRehashes;
+		stats.rehashing = isRehashing();
+		for (int i = 0; i <= Stats::MAX_CHAIN_LENGTH; i++)
+			stats.chainLengths[i] = 0;
+
+		for (int table = 0; table < 2; table++)
+		{
+			const std::vector<int>& heads = table ? this->oldBuckets : this->buckets;
+			for (size_t i = (table ? this->rehashCursor : 0); i < heads.size(); i++)
+			{
+				int length = 0;
+				for (int index = heads[i]; index != -1; index = node(index).nextHashLink)
+					length++;
+
+				stats.longestChain = std::max(stats.longestChain, length);
+				stats.chainLengths[std::min(length, static_cast<int>(Stats::MAX_CHAIN_LENGTH))]++;
+			}
+		}
 	}
 
 	Vector3int32 SpatialHash::realToHashGrid(const Vector3& realPoint)
@@ -70,189 +198,381 @@ namespace RBX
 		return Extents(hashGrid * 8.0f, (hashGrid + Vector3(1, 1, 1)) * 8.0f);
 	}
 
-	void SpatialHash::computeMinMax(const Extents& extents, Vector3int32& min, Vector3int32& max)
+	float SpatialHash::levelGridSize(int level)
 	{
-		min = SpatialHash::realToHashGrid(extents.min());
-		max = SpatialHash::realToHashGrid(extents.max());
+		return 8.0f * (1 << (levelShift() * level));
 	}
 
-	void SpatialHash::removeNodeFromHash(SpatialNode* remove)
+	float SpatialHash::shortestSide(const Extents& extents)
 	{
-		SpatialNode** temp = &this->nodes[remove->hashId];
-		while (*temp != remove)
+		G3D::Vector3 size = extents.size();
+		return std::min(size.x, std::min(size.y, size.z));
+	}
+
+	// Finest level whose cells are at least as large as the extents' shortest side - a baseplate or a
+	// long beam spreads over many small cells instead of sharing one huge cell with everything near it
+	int SpatialHash::computeLevel(const Extents& extents)
+	{
+		float size = shortestSide(extents);
+		int level = 0;
+		while (level < numLevels() - 1 && size > levelGridSize(level))
+			level++;
+		return level;
+	}
+
+	// Keeps the current level until the extents no longer fit or shrink well below it, so a
+	// rotating part (whose extents vary by up to sqrt(3)) does not bounce between levels
+	int SpatialHash::computeLevel(const Extents& extents, int currentLevel)
+	{
+		float size = shortestSide(extents);
+		bool fits = currentLevel == numLevels() - 1 || size <= levelGridSize(currentLevel);
+		bool tooCoarse = currentLevel > 0 && size < 0.5f * levelGridSize(currentLevel - 1);
+		return (fits && !tooCoarse) ? currentLevel : computeLevel(extents);
+	}
+
+	Vector3int32 SpatialHash::toCoarserLevel(const Vector3int32& grid, int levels)
+	{
+		int shift = levelShift() * levels;
+		return Vector3int32(grid.x >> shift, grid.y >> shift, grid.z >> shift);
+	}
+
+	void SpatialHash::computeMinMax(const Extents& extents, int level, Vector3int32& min, Vector3int32& max)
+	{
+		float recip = 1.0f / levelGridSize(level);
+		min = Vector3int32::floor(extents.min() * recip);
+		max = Vector3int32::floor(extents.max() * recip);
+	}
+
+	// Chains are doubly linked, so a node leaves a long shadow chain without walking it
+	void SpatialHash::removeNodeFromHash(int remove)
+	{
+		const SpatialNode& removeNode = node(remove);
+		int next = removeNode.nextHashLink;
+		int prev = links(remove).prevHashLink;
+
+		if (next != -1)
+			links(next).prevHashLink = prev;
+
+		if (prev != -1)
 		{
-			temp = &(*temp)->nextHashLink;
+			node(prev).nextHashLink = next;
+			return;
 		}
-		*temp = remove->nextHashLink;
+
+		unsigned int hash = getHash(removeNode.gridId, removeNode.level, removeNode.shadow);
+		int* head = &this->buckets[hash & (this->buckets.size() - 1)];
+		if (*head != remove)
+		{
+			// not moved out of the old table yet
+			RBXASSERT(isRehashing());
+			head = &this->oldBuckets[hash & (this->oldBuckets.size() - 1)];
+		}
+		RBXASSERT(*head == remove);
+		*head = next;
 	}
 
-	SpatialNode* SpatialHash::findNode(Primitive* p, const Vector3int32& grid)
+	int SpatialHash::findNode(Primitive* p, const Vector3int32& grid, int level)
 	{
-		int hash = SpatialHash::getHash(grid);
-		SpatialNode* result = this->nodes[hash];
-		while (result->primitive != p || result->gridId != grid)
+		int heads[2];
+		int numChains = cellChains(getHash(grid, level, level != p->spatialLevel), heads);
+		for (int chain = 0; chain < numChains; chain++)
 		{
-			result = result->nextHashLink;
+			for (int index = heads[chain]; index != -1; index = node(index).nextHashLink)
+			{
+				const SpatialNode& candidate = node(index);
+				if (candidate.primitive == p && candidate.gridId == grid && candidate.level == level)
+					return index;
+			}
 		}
-		return result;
+		RBXASSERT(0);
+		return -1;
 	}
 
-	void SpatialHash::destroyNode(SpatialNode* destroy)
+	void SpatialHash::insertNodeToPrimitive(int index, Primitive* p)
 	{
-		SpatialNode* nextPrimitiveLink = destroy->nextPrimitiveLink;
-		SpatialNode* prevPrimitiveLink = destroy->prevPrimitiveLink;
+		SpatialNodeLinks& nodeLinks = links(index);
+		int oldNodes = p->spatialNodes;
+		p->spatialNodes = index;
+		nodeLinks.nextPrimitiveLink = oldNodes;
+		nodeLinks.prevPrimitiveLink = -1;
+		if (oldNodes != -1)
+			links(oldNodes).prevPrimitiveLink = index;
+	}
 
-		if (nextPrimitiveLink)
-			nextPrimitiveLink->prevPrimitiveLink = prevPrimitiveLink;
+	void SpatialHash::removeNodeFromPrimitive(int index)
+	{
+		const SpatialNodeLinks& nodeLinks = links(index);
+		int nextPrimitiveLink = nodeLinks.nextPrimitiveLink;
+		int prevPrimitiveLink = nodeLinks.prevPrimitiveLink;
 
-		if (prevPrimitiveLink)
-			prevPrimitiveLink->nextPrimitiveLink = nextPrimitiveLink;
+		if (nextPrimitiveLink != -1)
+			links(nextPrimitiveLink).prevPrimitiveLink = prevPrimitiveLink;
+
+		if (prevPrimitiveLink != -1)
+			links(prevPrimitiveLink).nextPrimitiveLink = nextPrimitiveLink;
 		else
-			destroy->primitive->spatialNodes = nextPrimitiveLink;
+			node(index).primitive->spatialNodes = nextPrimitiveLink;
+	}
 
+	void SpatialHash::destroyNode(int destroy)
+	{
+		removeNodeFromPrimitive(destroy);
 		removeNodeFromHash(destroy);
+		returnNode(destroy);
+		rehashStep(rehashStepsPerChange());
+		checkLoad();
+	}
 
-		int destroyHash = destroy->hashId;
-		Vector3int32 destroyGrid = destroy->gridId;
-
-		for (SpatialNode* node = nodes[destroyHash]; node != NULL; node = node->nextHashLink)
+	// Shadow chains are left out of maxBucket: walking one to measure it would make filling a
+	// coarse cell quadratic. doStats still counts them.
+	void SpatialHash::addNode(Primitive* p, const Vector3int32& grid, int level)
+	{
+		bool shadow = (level != p->spatialLevel);
+		unsigned int hash = getHash(grid, level, shadow);
+		int index = newNode();
+
+		SpatialNode& added = node(index);
+		added.primitive = p;
+		added.gridId = grid;
+		added.level = static_cast<unsigned char>(level);
+		added.shadow = shadow;
+		insertNodeToPrimitive(index, p);
+
+		int& head = this->buckets[hash & (this->buckets.size() - 1)];
+		if (head != -1)
+			links(head).prevHashLink = index;
+		added.nextHashLink = head;
+		links(index).prevHashLink = -1;
+		head = index;
+
+		if (!shadow)
 		{
-			if (node->gridId == destroyGrid)
+			int numNodes = 0;
+			int heads[2];
+			int numChains = cellChains(hash, heads);
+			for (int chain = 0; chain < numChains; chain++)
 			{
-				Primitive* destroyPrim = destroy->primitive;
-				Primitive* nodePrim = node->primitive;
-				RBXASSERT(nodePrim != destroyPrim);
-				if (Primitive::getContact(destroyPrim, nodePrim) && !shareCommonGrid(destroyPrim, nodePrim))
-					this->contactManager->onReleasePair(destroyPrim, nodePrim);
+				for (int linked = heads[chain]; linked != -1; linked = node(linked).nextHashLink)
+				{
+					++numNodes;
+					const SpatialNode& linkedNode = node(linked);
+					RBXASSERT(linked == index || linkedNode.primitive != p || linkedNode.gridId != grid || linkedNode.level != level);
+				}
 			}
+			this->maxBucket = std::max(this->maxBucket, numNodes);
 		}
 
-		destroy->nextHashLink = this->extraNodes;
-		--this->nodesOut;
-		this->extraNodes = destroy;
+		rehashStep(rehashStepsPerChange());
+		checkLoad();
 	}
 
-	bool SpatialHash::shareCommonGrid(Primitive* me, Primitive* other)
+	// the primitive's nodes at one level, its own or a shadow level, from its current cell range
+	void SpatialHash::addNodes(Primitive* p, int level)
 	{
-		SpatialNode* spatialNodes = me->spatialNodes;
-		while (true)
+		Vector3int32 min = toCoarserLevel(p->oldSpatialMin, level - p->spatialLevel);
+		Vector3int32 max = toCoarserLevel(p->oldSpatialMax, level - p->spatialLevel);
+		for (int i = min.x; i <= max.x; i++)
 		{
-			if (!spatialNodes)
-				return false;
-			int hashId = spatialNodes->hashId;
-			SpatialNode* currentNode = this->nodes[hashId];
-			while (currentNode)
+			for (int j = min.y; j <= max.y; j++)
 			{
-				if (currentNode->primitive == other && currentNode->gridId == spatialNodes->gridId)
-					return true;
-				currentNode = currentNode->nextHashLink;
+				for (int k = min.z; k <= max.z; k++)
+				{
+					this->addNode(p, Vector3int32(i, j, k), level);
+				}
 			}
-			spatialNodes = spatialNodes->nextPrimitiveLink;
 		}
 	}
 
-	void SpatialHash::addNode(Primitive* p, const Vector3int32& grid)
+	void SpatialHash::insertPrimitive(Primitive* p, int level)
 	{
-		int hash = getHash(grid);
+		RBXASSERT(p->spatialNodes == -1);
+		SpatialHash::computeMinMax(p->getFatExtents(), level, p->oldSpatialMin, p->oldSpatialMax);
+		p->spatialLevel = level;
+		this->primitivesAtLevel[level]++;
 
-		SpatialNode* node = this->extraNodes;
-		++this->nodesOut;
-		if (node)
-			this->extraNodes = node->nextHashLink;
-		else
-			node = new SpatialNode();
+		for (int l = level; l < numLevels(); l++)
+			addNodes(p, l);
+	}
 
-		node->primitive = p;
-		node->gridId = grid;
-		node->hashId = hash;
+	// leaves the primitive's pairs alone, updatePairs or onPrimitiveRemoved sorts them out
+	void SpatialHash::removePrimitive(Primitive* p)
+	{
+		while (p->spatialNodes != -1)
+			destroyNode(p->spatialNodes);
 
-		SpatialNode* oldNodes = p->spatialNodes;
-		p->spatialNodes = node;
-		node->nextPrimitiveLink = oldNodes;
-		node->prevPrimitiveLink = NULL;
-		if (oldNodes)
-			oldNodes->prevPrimitiveLink = node;
+		this->primitivesAtLevel[p->spatialLevel]--;
+		p->spatialLevel = -1;
+	}
 
-		SpatialNode* linkedNode = this->nodes[hash];
-		node->nextHashLink = linkedNode;
-		this->nodes[hash] = node;
+	// Called after the primitive's fat extents were rebuilt and its nodes moved: releases the pairs
+	// whose fat extents came apart, then pairs it with everything in its cells it now overlaps.
+	// Other primitives' fat extents are unchanged, so no other pair can have started or ended.
+	void SpatialHash::updatePairs(Primitive* p)
+	{
+		Contact* next;
+		for (Contact* contact = p->getFirstContact(); contact != NULL; contact = next)
+		{
+			next = p->getNextContact(contact);
+			Primitive* other = contact->otherPrimitive(p);
+			if (!p->getFatExtents().overlapsOrTouches(other->getFatExtents()))
+				this->contactManager->onReleasePair(p, other);
+		}
 
-		int numNodes = 1;
-		while (linkedNode)
+		// collect first - creating a contact must not run while a bucket is being walked
+		this->traverseStamp++;
+		this->candidates.fastClear();
+		for (int level = p->spatialLevel; level < numLevels(); level++)
 		{
-			++numNodes;
+			if (this->primitivesAtLevel[level] == 0)
+				continue;
 
-			Primitive* linkedP = linkedNode->primitive;
-			if (linkedP != p && linkedNode->gridId == grid)
-			{
-				if (!Primitive::getContact(p, linkedP))
-					this->contactManager->onNewPair(p, linkedP);
-			}
-			else
+			Vector3int32 min;
+			Vector3int32 max;
+			SpatialHash::computeMinMax(p->getFatExtents(), level, min, max);
+
+			// finer primitives are all shadowed at the primitive's own level
+			bool shadows = (level == p->spatialLevel);
+			for (int i = min.x; i <= max.x; i++)
 			{
-				RBXASSERT(grid != linkedNode->gridId);
+				for (int j = min.y; j <= max.y; j++)
+				{
+					for (int k = min.z; k <= max.z; k++)
+					{
+						int begin = this->candidates.size();
+						this->getPrimitivesInCell(Vector3int32(i, j, k), level, shadows, this->candidates);
+						compactNewPrimitives(this->candidates, begin, NULL, p);
+					}
+				}
 			}
-
-			linkedNode = linkedNode->nextHashLink;
 		}
 
-		this->maxBucket = std::max(this->maxBucket, numNodes);
+		for (int i = 0; i < this->candidates.size(); i++)
+		{
+			Primitive* other = this->candidates[i];
+			if (!Primitive::getContact(p, other) && p->getFatExtents().overlapsOrTouches(other->getFatExtents()))
+				this->contactManager->onNewPair(p, other);
+		}
 	}
 
-	void SpatialHash::changeMinMax(Primitive* p, const Extents& change, const Extents& oldBox, const Extents& newBox)
+	static bool inRange(const Vector3int32& grid, const Vector3int32& min, const Vector3int32& max)
 	{
-		Vector3int32 min = Vector3int32::floor(change.min());
-		Vector3int32 max = Vector3int32::floor(change.max());
+		return
+			grid.x >= min.x && grid.y >= min.y && grid.z >= min.z &&
+			grid.x <= max.x && grid.y <= max.y && grid.z <= max.z;
+	}
 
-		for (int i = min.x; i <= max.x; ++i)
+	// Reads only the primitive, so moves for different primitives can be computed in parallel.
+	void SpatialHash::computeMove(Primitive* p, Move& move, G3D::Array<CellChange>& changes)
+	{
+		RBXASSERT(p->spatialNodes != -1);
+		const Extents& fatExtents = p->getFatExtents();
+		move.primitive = p;
+		move.level = SpatialHash::computeLevel(fatExtents, p->spatialLevel);
+		move.firstChange = changes.size();
+		move.numChanges = 0;
+		if (move.level != p->spatialLevel)
+			return;
+
+		SpatialHash::computeMinMax(fatExtents, move.level, move.min, move.max);
+		if (move.min == p->oldSpatialMin && move.max == p->oldSpatialMax)
+			return;
+
+		for (int l = move.level; l < numLevels(); l++)
 		{
-			for (int j = min.y; j <= max.y; ++j)
+			Vector3int32 oldMin = toCoarserLevel(p->oldSpatialMin, l - move.level);
+			Vector3int32 oldMax = toCoarserLevel(p->oldSpatialMax, l - move.level);
+			Vector3int32 newMin = toCoarserLevel(move.min, l - move.level);
+			Vector3int32 newMax = toCoarserLevel(move.max, l - move.level);
+			if (newMin == oldMin && newMax == oldMax)
+				break;
+
+			// adds go first so a pair kept through a shared new cell is never released
+			for (int add = 1; add >= 0; add--)
 			{
-				for (int k = min.z; k <= max.z; ++k)
+				const Vector3int32& min = add ? newMin : oldMin;
+				const Vector3int32& max = add ? newMax : oldMax;
+				const Vector3int32& otherMin = add ? oldMin : newMin;
+				const Vector3int32& otherMax = add ? oldMax : newMax;
+				for (int i = min.x; i <= max.x; i++)
 				{
-					bool inNew = newBox.contains(Vector3(i, j, k));
-					bool inOld = oldBox.contains(Vector3(i, j, k));
-
-					if (inNew)
+					for (int j = min.y; j <= max.y; j++)
 					{
-						if (!inOld)
-							addNode(p, Vector3int32(i, j, k));
-					}
-					else if (inOld)
-					{
-						SpatialNode* node = findNode(p, Vector3int32(i, j, k));
-						destroyNode(node);
+						for (int k = min.z; k <= max.z; k++)
+						{
+							Vector3int32 grid(i, j, k);
+							if (!inRange(grid, otherMin, otherMax))
+							{
+								CellChange change;
+								change.grid = grid;
+								change.level = l;
+								change.add = (add == 1);
+								changes.append(change);
+							}
+						}
 					}
 				}
 			}
 		}
+		move.numChanges = changes.size() - move.firstChange;
 	}
 
-	void SpatialHash::primitiveExtentsChanged(Primitive* p)
+	void SpatialHash::applyMove(const Move& move, const CellChange* changes)
 	{
-		RBXASSERT(p->spatialNodes);
-		Vector3int32 newMin;
-		Vector3int32 newMax;
-		const Extents& fuzzyExtents = p->getFastFuzzyExtents();
-		SpatialHash::computeMinMax(fuzzyExtents, newMin, newMax);
-		if (newMin != p->oldSpatialMin || newMax != p->oldSpatialMax)
+		Primitive* p = move.primitive;
+		if (move.level != p->spatialLevel)
+		{
+			removePrimitive(p);
+			insertPrimitive(p, move.level);
+		}
+		else
 		{
-			Extents newBox(newMin, newMax);
-			Extents oldBox(p->oldSpatialMin, p->oldSpatialMax);
-			if (newBox.overlapsOrTouches(oldBox))
+			for (int i = 0; i < move.numChanges; i++)
 			{
-				Extents unionBox(newBox);
-				unionBox.unionWith(oldBox);
-				this->changeMinMax(p, unionBox, oldBox, newBox);
+				const CellChange& change = changes[move.firstChange + i];
+				if (change.add)
+					addNode(p, change.grid, change.level);
+				else
+					destroyNode(findNode(p, change.grid, change.level));
 			}
-			else
+			p->oldSpatialMin = move.min;
+			p->oldSpatialMax = move.max;
+		}
+		updatePairs(p);
+	}
+
+	void SpatialHash::primitiveExtentsChanged(Primitive* p)
+	{
+		if (!p->updateFatExtents())
+			return;
+
+		Move move;
+		G3D::Array<CellChange> changes;
+		computeMove(p, move, changes);
+		applyMove(move, changes.getCArray());
+	}
+
+	void SpatialHash::MoveTask::run()
+	{
+		moves.fastClear();
+		changes.fastClear();
+		numKept = 0;
+		numShrunk = 0;
+		for (int i = begin; i < end; i++)
+		{
+			// only this task touches these primitives' fat extents
+			Primitive* primitive = (*primitives)[i];
+			bool shrunk;
+			if (!primitive->updateFatExtents(shrunk))
 			{
-				this->changeMinMax(p, oldBox, oldBox, newBox);
-				this->changeMinMax(p, newBox, oldBox, newBox);
+				numKept++;
+				continue;
 			}
-			p->oldSpatialMin = newMin;
-			p->oldSpatialMax = newMax;
+			if (shrunk)
+				numShrunk++;
 
+			Move move;
+			SpatialHash::computeMove(primitive, move, changes);
+			moves.append(move);
 		}
 	}
 
@@ -263,65 +583,250 @@ namespace RBX
 
 	void SpatialHash::onPrimitiveAdded(Primitive* p)
 	{
-		RBXASSERT(!p->spatialNodes);
-		Vector3int32 newMin;
-		Vector3int32 newMax;
-		const Extents& fuzzyExtents = p->getFastFuzzyExtents();
-		SpatialHash::computeMinMax(fuzzyExtents, newMin, newMax);
-		p->oldSpatialMin = newMin;
-		p->oldSpatialMax = newMax;
-		for (int i = newMin.x; i <= newMax.x; i++)
+		p->updateFatExtents();
+		insertPrimitive(p, SpatialHash::computeLevel(p->getFatExtents()));
+		updatePairs(p);
+	}
+
+	void SpatialHash::onPrimitiveRemoved(Primitive* p)
+	{
+		while (Contact* contact = p->getFirstContact())
+			this->contactManager->onReleasePair(p, contact->otherPrimitive(p));
+
+		removePrimitive(p);
+	}
+
+	// New cell ranges are computed in parallel on the kernel's worker pool, then applied on this
+	// thread in primitive order - so the nodes and pair callbacks come out the same as a serial pass.
+	// A pair between two moved primitives is judged on both fat extents as rebuilt this step; if the
+	// first one applied misses the other in its stale cells, the other finds it when applied.
+	void SpatialHash::onAllPrimitivesMoved()
+	{
+		rehashStep(rehashStepsPerWorldStep());
+
+		const G3D::Array<Primitive*>& movingPrimitives = this->world->getMovingPrimitives();
+		for (int i = 0; i < movingPrimitives.size(); i++)
+		{
+			Primitive* primitive = movingPrimitives[i];
+			RBXASSERT(primitive->getAssembly()->moving());
+
+			// brings body PVs shared within the clump up to date before the tasks read them
+			primitive->getCoordinateFrame();
+		}
+
+		WorkerPool* workerPool = this->world->getKernel().getWorkerPool();
+		int numTasks = 1;
+		if (workerPool)
 		{
-			for (int j = newMin.y; j <= newMax.y; j++)
+			int maxTasks = 4 * (workerPool->numThreads() + 1);
+			numTasks = std::max(1, std::min(maxTasks, movingPrimitives.size() / minPrimitivesPerTask()));
+		}
+
+		while (moveTasks.size() < numTasks)
+		{
+			moveTasks.append(new MoveTask());
+			moveTaskPointers.append(moveTasks.last());
+		}
+
+		for (int i = 0; i < numTasks; i++)
+		{
+			MoveTask* task = moveTasks[i];
+			task->primitives = &movingPrimitives;
+			task->begin = movingPrimitives.size() * i / numTasks;
+			task->end = movingPrimitives.size() * (i + 1) / numTasks;
+		}
+
+		if (numTasks > 1)
+			workerPool->run(moveTaskPointers.getCArray(), numTasks);
+		else
+			moveTasks[0]->run();
+
+		this->numFatExtentsKept = 0;
+		this->numFatExtentsShrunk = 0;
+		for (int i = 0; i < numTasks; i++)
+		{
+			const MoveTask* task = moveTasks[i];
+			this->numFatExtentsKept += task->numKept;
+			this->numFatExtentsShrunk += task->numShrunk;
+			for (int j = 0; j < task->moves.size(); j++)
+				applyMove(task->moves[j], task->changes.getCArray());
+		}
+	}
+
+	void SpatialHash::getPrimitivesInCell(const Vector3int32& grid, int level, bool shadows, G3D::Array<Primitive*>& found)
+	{
+		for (int shadow = 0; shadow <= (shadows ? 1 : 0); shadow++)
+		{
+			int heads[2];
+			int numChains = cellChains(getHash(grid, level, shadow == 1), heads);
+			for (int chain = 0; chain < numChains; chain++)
 			{
-				for (int k = newMin.z; k <= newMax.z; k++)
+				for (int index = heads[chain]; index != -1; index = node(index).nextHashLink)
 				{
-					this->addNode(p, Vector3int32(i, j, k));
+					const SpatialNode& candidate = node(index);
+					if (candidate.gridId == grid && candidate.level == level && candidate.shadow == (shadow == 1))
+						found.append(candidate.primitive);
 				}
 			}
 		}
 	}
 
-	void SpatialHash::onPrimitiveRemoved(Primitive* p)
+	// grid is a level 0 cell; primitives stored at coarser levels are found through the cells covering it
+	void SpatialHash::getPrimitivesInGrid(const Vector3int32& grid, G3D::Array<Primitive*>& found)
 	{
-		for (SpatialNode* node = p->spatialNodes; node != NULL; node = p->spatialNodes)
-			destroyNode(node);
+		RBXASSERT(found.size() == 0);
+		for (int level = 0; level < numLevels(); level++)
+		{
+			if (this->primitivesAtLevel[level] > 0)
+				this->getPrimitivesInCell(toCoarserLevel(grid, level), level, false, found);
+		}
 	}
 
-	void SpatialHash::onAllPrimitivesMoved()
+	// Keeps the entries from begin on that pass keepPrimitive and haven't been seen this query -
+	// a primitive is listed in every cell it covers, and traverseId remembers the last query it was kept by.
+	void SpatialHash::compactNewPrimitives(G3D::Array<Primitive*>& answer, int begin, const Extents* extents, const Primitive* ignore)
 	{
-		const G3D::Array<Primitive*>& primitives = this->world->getPrimitives();
-		for (int i = 0; i < primitives.size(); i++)
+		int kept = begin;
+		for (int i = begin; i < answer.size(); i++)
 		{
-			Primitive* primitive = primitives[i];
-			RBXASSERT(primitive);
-			RBXASSERT(primitive->getClump());
-			if (primitive->getAssembly()->moving())
-				this->primitiveExtentsChanged(primitive);
+			Primitive* primitive = answer[i];
+			if (primitive->traverseId == this->traverseStamp || primitive == ignore)
+				continue;
+
+			primitive->traverseId = this->traverseStamp;
+			if (!extents || extents->overlapsOrTouches(primitive->getFastFuzzyExtents()))
+				answer[kept++] = primitive;
 		}
+		answer.resize(kept, false);
 	}
 
-	void SpatialHash::getPrimitivesInGrid(const Vector3int32& grid, G3D::Array<Primitive*>& found)
+	void SpatialHash::getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer)
 	{
-		RBXASSERT(found.size() == 0);
-		int hash = SpatialHash::getHash(grid);
-		SpatialNode* node = this->nodes[hash];
-		while (node)
+		RBXASSERT(answer.size() == 0);
+		this->traverseStamp++;
+
+		for (int level = 0; level < numLevels(); level++)
 		{
-			if (node->gridId == grid)
-				found.append(node->primitive);
+			if (this->primitivesAtLevel[level] == 0)
+				continue;
+
+			Vector3int32 min;
+			Vector3int32 max;
+			SpatialHash::computeMinMax(extents, level, min, max);
 
-			node = node->nextHashLink;
+			for (int i = min.x; i <= max.x; i++)
+			{
+				for (int j = min.y; j <= max.y; j++)
+				{
+					for (int k = min.z; k <= max.z; k++)
+					{
+						int begin = answer.size();
+						this->getPrimitivesInCell(Vector3int32(i, j, k), level, false, answer);
+						compactNewPrimitives(answer, begin, &extents, ignore);
+					}
+				}
+			}
 		}
 	}
 
-	void SpatialHash::getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer)
+	void SpatialHash::getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(answer.size() == 0);
+		this->traverseStamp++;
+		RayWalk walk(unitRay, maxDistance);
+
+		do
+		{
+			for (int level = 0; level < numLevels(); level++)
+			{
+				if (this->primitivesAtLevel[level] == 0)
+					continue;
+
+				int begin = answer.size();
+				this->getPrimitivesInCell(toCoarserLevel(walk.getGrid(), level), level, false, answer);
+				compactNewPrimitives(answer, begin, NULL, NULL);
+			}
+		}
+		while (walk.next());
+	}
+
+	bool SpatialHash::hasShadows(const Vector3int32& grid, int level) const
+	{
+		int heads[2];
+		int numChains = cellChains(getHash(grid, level, true), heads);
+		for (int chain = 0; chain < numChains; chain++)
+		{
+			for (int index = heads[chain]; index != -1; index = node(index).nextHashLink)
+			{
+				const SpatialNode& candidate = node(index);
+				if (candidate.gridId == grid && candidate.level == level && candidate.shadow)
+					return true;
+			}
+		}
+		return false;
+	}
+
+	// A cell found fully inside takes every node in it, shadows included, since a primitive's shadow
+	// node lies in each covering cell of every coarser level. A partly covered cell tests the
+	// primitives stored at its own level and descends one level only when it holds shadows of finer
+	// ones; empty children hold no nodes and stop at the lookup, so the walk stays on occupied cells.
+	void SpatialHash::cullCell(const GCamera::Frustum& frustum, const Extents& bounds, const Vector3int32& grid, int level, G3D::Array<Primitive*>& answer)
+	{
+		float size = levelGridSize(level);
+		Extents box(grid.toVector3() * size, (grid.toVector3() + Vector3(1, 1, 1)) * size);
+		Containment containment = cullExtents(box, frustum, bounds);
+		if (containment == OUTSIDE)
+			return;
+
+		bool inside = (containment == INSIDE);
+		int begin = answer.size();
+		this->getPrimitivesInCell(grid, level, inside, answer);
+
+		int kept = begin;
+		for (int i = begin; i < answer.size(); i++)
+		{
+			Primitive* primitive = answer[i];
+			if (primitive->traverseId == this->traverseStamp)
+				continue;
+
+			primitive->traverseId = this->traverseStamp;
+			if (inside || cullExtents(primitive->getFastFuzzyExtents(), frustum, bounds) != OUTSIDE)
+				answer[kept++] = primitive;
+		}
+		answer.resize(kept, false);
+
+		if (inside || level == 0 || !hasShadows(grid, level))
+			return;
+
+		int finer = level - 1;
+		int children = 1 << levelShift();
+		Vector3int32 first(grid.x * children, grid.y * children, grid.z * children);
+		for (int i = 0; i < children; i++)
+		{
+			for (int j = 0; j < children; j++)
+			{
+				for (int k = 0; k < children; k++)
+				{
+					cullCell(frustum, bounds, Vector3int32(first.x + i, first.y + j, first.z + k), finer, answer);
+				}
+			}
+		}
+	}
+
+	void SpatialHash::getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer)
 	{
 		RBXASSERT(answer.size() == 0);
+		this->traverseStamp++;
+
+		if (this->nodesOut == 0)
+			return;
+
+		// the top level holds a node or shadow of every primitive
+		int level = numLevels() - 1;
+
 		Vector3int32 min;
 		Vector3int32 max;
-		SpatialHash::computeMinMax(extents, min, max);
-		G3D::Array<Primitive*> foundThisGrid;
+		SpatialHash::computeMinMax(bounds, level, min, max);
 
 		for (int i = min.x; i <= max.x; i++)
 		{
@@ -329,68 +834,168 @@ namespace RBX
 			{
 				for (int k = min.z; k <= max.z; k++)
 				{
-					foundThisGrid.fastClear();
-					this->getPrimitivesInGrid(Vector3int32(i, j, k), foundThisGrid);
-					for (int l = 0; l < foundThisGrid.size(); l++)
-					{
-						Primitive* primitive = foundThisGrid[l];
-						if (primitive != ignore && !answer.contains(primitive))
-						{
-							if (extents.overlapsOrTouches(primitive->getFastFuzzyExtents()))
-								answer.append(primitive);
-						}
-					}
+					cullCell(frustum, bounds, Vector3int32(i, j, k), level, answer);
 				}
 			}
 		}
-		RBXASSERT(foundThisGrid.size() < 200);
 	}
 
-	bool SpatialHash::getNextGrid(Vector3int32& grid, const G3D::Ray& unitRay, float maxDistance)
+	// Adds the primitives stored in or over a level 0 cell to nearby if their position is close enough.
+	// Returns how many had not been seen yet this query, passing or not.
+	int SpatialHash::gatherNearby(const Vector3int32& grid, const G3D::Vector3& point, float maxDistanceSquared, const HitTestFilter* filter, G3D::Array<Primitive*>& scratch)
 	{
-		Vector3int32 min;
-		Vector3int32 max;
-
-		for (int i = 0; i < 3; i++)
+		scratch.fastClear();
+		for (int level = 0; level < numLevels(); level++)
 		{
-			min[i] = unitRay.direction[i] < 0.0f ? -1 : 0;
-			max[i] = unitRay.direction[i] > 0.0f ? 1 : 0;
+			if (this->primitivesAtLevel[level] == 0)
+				continue;
+
+			int begin = scratch.size();
+			this->getPrimitivesInCell(toCoarserLevel(grid, level), level, false, scratch);
+			compactNewPrimitives(scratch, begin, NULL, NULL);
 		}
 
-		Vector3 gridF = grid.toVector3();
-		float distanceSquared = square(maxDistance + 16.0f);
+		for (int i = 0; i < scratch.size(); i++)
+		{
+			Primitive* primitive = scratch[i];
+			float distanceSquared = (primitive->getCoordinateFrame().translation - point).squaredLength();
+			if (distanceSquared <= maxDistanceSquared && (!filter || filter->filterResult(primitive) != HitTestFilter::IGNORE_PRIM))
+			{
+				NearbyPrimitive found = {distanceSquared, primitive};
+				this->nearby.append(found);
+			}
+		}
+		return scratch.size();
+	}
 
-		for (int idfk = 1; idfk <= 3; idfk++)
+	// Visits level 0 cells in rings of growing Chebyshev radius around the point's cell. Once ring r is
+	// done every position within covered = r cells plus the point's distance to its own cell's border
+	// has been seen, so the search ends when maxCount results lie within covered, covered passes
+	// maxDistance, or every primitive in the hash has been seen.
+	// Ring cell counts grow with r squared, so in a sparse world the walk gives up once it would visit
+	// more than nearestCellsPerPrimitive() cells per primitive and scans the world's primitives instead.
+	void SpatialHash::getNearestPrimitives(const G3D::Vector3& point, float maxDistance, int maxCount, const HitTestFilter* filter, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(answer.size() == 0);
+		RBXASSERT(maxCount > 0);
+		this->traverseStamp++;
+		this->nearby.fastClear();
+
+		int numPrimitives = 0;
+		for (int level = 0; level < numLevels(); level++)
+			numPrimitives += this->primitivesAtLevel[level];
+
+		float size = levelGridSize(0);
+		Vector3int32 center = realToHashGrid(point);
+		G3D::Vector3 inCell = point - center.toVector3() * size;
+		float border = std::min(std::min(std::min(inCell.x, size - inCell.x), std::min(inCell.y, size - inCell.y)), std::min(inCell.z, size - inCell.z));
+		float maxDistanceSquared = maxDistance * maxDistance;
+
+		int numSeen = 0;
+		int numCells = 0;
+		int maxCells = std::max(minNearestCells(), nearestCellsPerPrimitive() * numPrimitives);
+		for (int ring = 0; numSeen < numPrimitives; ring++)
 		{
-			for (int i = min.x; i <= max.x; i++)
+			numCells += (ring == 0) ? 1 : 24 * ring * ring + 2;
+			if (numCells > maxCells)
 			{
-				for (int j = min.y; j <= max.y; j++)
+				const G3D::Array<Primitive*>& primitives = this->world->getPrimitives();
+				for (int i = 0; i < primitives.size(); i++)
 				{
-					for (int k = min.z; k <= max.z; k++)
+					Primitive* primitive = primitives[i];
+					if (primitive->spatialLevel == -1 || primitive->traverseId == this->traverseStamp)
+						continue;
+
+					primitive->traverseId = this->traverseStamp;
+					float distanceSquared = (primitive->getCoordinateFrame().translation - point).squaredLength();
+					if (distanceSquared <= maxDistanceSquared && (!filter || filter->filterResult(primitive) != HitTestFilter::IGNORE_PRIM))
 					{
-						if (abs(i)+abs(j)+abs(k) == idfk)
-						{
-							Vector3 offset(i, j, k);
-							Vector3 offsetGridF = (offset + gridF);
-							G3D::AABox box(offsetGridF * 8.0f, (offsetGridF + Vector3(1,1,1)) * 8.0f);
-							G3D::Vector3 location;
-
-							bool hit = G3D::CollisionDetection::collisionLocationForMovingPointFixedAABox(
-								unitRay.origin,
-								unitRay.direction,
-								box,
-								location);
-
-							if (hit && (location - unitRay.origin).squaredMagnitude() < distanceSquared)
-							{
-									grid = Vector3int32::floor(offset + gridF);
-									return true;
-							}
-						}
+						NearbyPrimitive found = {distanceSquared, primitive};
+						this->nearby.append(found);
 					}
 				}
+				break;
+			}
+
+			for (int i = -ring; i <= ring; i++)
+			{
+				for (int j = -ring; j <= ring; j++)
+				{
+					// inside the ring's shell only its two z faces are new
+					bool onShell = (abs(i) == ring || abs(j) == ring);
+					int kStep = (onShell || ring == 0) ? 1 : 2 * ring;
+					for (int k = -ring; k <= ring; k += kStep)
+					{
+						Vector3int32 grid(center.x + i, center.y + j, center.z + k);
+						numSeen += gatherNearby(grid, point, maxDistanceSquared, filter, answer);
+					}
+				}
+			}
+
+			float covered = ring * size + border;
+			if (covered >= maxDistance)
+				break;
+
+			if (this->nearby.size() >= maxCount)
+			{
+				NearbyPrimitive* first = this->nearby.getCArray();
+				std::nth_element(first, first + maxCount - 1, first + this->nearby.size());
+				if (this->nearby[maxCount - 1].distanceSquared <= covered * covered)
+					break;
 			}
 		}
-		return false;
+
+		NearbyPrimitive* first = this->nearby.getCArray();
+		int count = std::min(maxCount, this->nearby.size());
+		std::partial_sort(first, first + count, first + this->nearby.size());
+
+		answer.resize(count, false);
+		for (int i = 0; i < count; i++)
+			answer[i] = this->nearby[i].primitive;
+	}
+
+	SpatialHash::RayWalk::RayWalk(const G3D::Ray& unitRay, float maxDistance)
+		: grid(SpatialHash::realToHashGrid(unitRay.origin)),
+		maxDistance(maxDistance)
+	{
+		float size = SpatialHash::levelGridSize(0);
+		for (int i = 0; i < 3; i++)
+		{
+			float direction = unitRay.direction[i];
+			if (direction > 0.0f)
+			{
+				step[i] = 1;
+				nextBoundary[i] = ((grid[i] + 1) * size - unitRay.origin[i]) / direction;
+				boundaryDelta[i] = size / direction;
+			}
+			else if (direction < 0.0f)
+			{
+				step[i] = -1;
+				nextBoundary[i] = (grid[i] * size - unitRay.origin[i]) / direction;
+				boundaryDelta[i] = -size / direction;
+			}
+			else
+			{
+				step[i] = 0;
+				nextBoundary[i] = Math::inf();
+				boundaryDelta[i] = Math::inf();
+			}
+		}
+	}
+
+	bool SpatialHash::RayWalk::next()
+	{
+		int axis = 0;
+		if (nextBoundary[1] < nextBoundary[axis])
+			axis = 1;
+		if (nextBoundary[2] < nextBoundary[axis])
+			axis = 2;
+
+		if (nextBoundary[axis] > maxDistance)
+			return false;
+
+		grid[axis] += step[axis];
+		nextBoundary[axis] += boundaryDelta[axis];
+		return true;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,396 @@
+#include "v8world/SweepAndPrune.h"
+#include <algorithm>
+#include "v8world/Primitive.h"
+#include "v8world/ContactManager.h"
+#include "v8world/World.h"
+#include "v8world/Assembly.h"
+#include "util/Math.h"
+#include "util/Debug.h"
+
+namespace RBX
+{
+	SweepAndPrune::SweepAndPrune(World* world, ContactManager* contactManager)
+		: world(world),
+		  contactManager(contactManager),
+		  freeProxy(-1),
+		  numProxies(0),
+		  numSwaps(0),
+		  maxWidth(0.0f),
+		  widestProxy(-1),
+		  maxWidthDirty(false)
+	{
+	}
+
+	SweepAndPrune::~SweepAndPrune()
+	{
+		RBXASSERT(numProxies == 0);
+	}
+
+	int SweepAndPrune::allocateProxy()
+	{
+		if (freeProxy == -1)
+		{
+			proxies.append(Proxy());
+			return proxies.size() - 1;
+		}
+
+		int index = freeProxy;
+		freeProxy = proxies[index].nextFree;
+		return index;
+	}
+
+	void SweepAndPrune::setEndpoint(int axis, int index, const Endpoint& endpoint)
+	{
+		axes[axis][index] = endpoint;
+		proxies[endpoint.proxy].endpoint[axis][endpoint.isMax] = index;
+	}
+
+	void SweepAndPrune::swapEndpoints(int axis, int index0, int index1)
+	{
+		Endpoint endpoint0 = axes[axis][index0];
+		setEndpoint(axis, index0, axes[axis][index1]);
+		setEndpoint(axis, index1, endpoint0);
+		numSwaps++;
+	}
+
+	// a min moving down past a max may start a pair, a max moving down past a min may end one
+	void SweepAndPrune::sortDown(int axis, int index, bool reportPairs)
+	{
+		G3D::Array<Endpoint>& endpoints = axes[axis];
+		while (index > 0 && endpoints[index].value < endpoints[index - 1].value)
+		{
+			int movingProxy = endpoints[index].proxy;
+			int otherProxy = endpoints[index - 1].proxy;
+			bool movingIsMax = endpoints[index].isMax;
+			bool otherIsMax = endpoints[index - 1].isMax;
+
+			swapEndpoints(axis, index, index - 1);
+			index--;
+
+			if (reportPairs && movingProxy != otherProxy && movingIsMax != otherIsMax && proxies[otherProxy].primitive)
+			{
+				if (movingIsMax)
+					onEndOverlap(movingProxy, otherProxy);
+				else
+					onBeginOverlap(movingProxy, otherProxy);
+			}
+		}
+	}
+
+	void SweepAndPrune::sortUp(int axis, int index, bool reportPairs)
+	{
+		G3D::Array<Endpoint>& endpoints = axes[axis];
+		while (index < endpoints.size() - 1 && endpoints[index + 1].value < endpoints[index].value)
+		{
+			int movingProxy = endpoints[index].proxy;
+			int otherProxy = endpoints[index + 1].proxy;
+			bool movingIsMax = endpoints[index].isMax;
+			bool otherIsMax = endpoints[index + 1].isMax;
+
+			swapEndpoints(axis, index, index + 1);
+			index++;
+
+			if (reportPairs && movingProxy != otherProxy && movingIsMax != otherIsMax && proxies[otherProxy].primitive)
+			{
+				if (movingIsMax)
+					onBeginOverlap(movingProxy, otherProxy);
+				else
+					onEndOverlap(movingProxy, otherProxy);
+			}
+		}
+	}
+
+	// boxes are already final on every axis, so each event re-tests the whole overlap
+	void SweepAndPrune::onBeginOverlap(int proxy0, int proxy1)
+	{
+		Primitive* p0 = proxies[proxy0].primitive;
+		Primitive* p1 = proxies[proxy1].primitive;
+		if (proxies[proxy0].box.overlapsOrTouches(proxies[proxy1].box) && !Primitive::getContact(p0, p1))
+			contactManager->onNewPair(p0, p1);
+	}
+
+	void SweepAndPrune::onEndOverlap(int proxy0, int proxy1)
+	{
+		Primitive* p0 = proxies[proxy0].primitive;
+		Primitive* p1 = proxies[proxy1].primitive;
+		if (!proxies[proxy0].box.overlapsOrTouches(proxies[proxy1].box) && Primitive::getContact(p0, p1))
+			contactManager->onReleasePair(p0, p1);
+	}
+
+	// maxWidth only ever rises to a new width here, so it stays an upper bound on every box
+	void SweepAndPrune::onWidthChanged(int proxy)
+	{
+		const Extents& box = proxies[proxy].box;
+		float width = box.max().x - box.min().x;
+		if (width >= maxWidth)
+		{
+			maxWidth = width;
+			widestProxy = proxy;
+			maxWidthDirty = false;
+		}
+		else if (proxy == widestProxy)
+			maxWidthDirty = true;
+	}
+
+	void SweepAndPrune::updateProxy(int proxy, const Extents& box)
+	{
+		proxies[proxy].box = box;
+		onWidthChanged(proxy);
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			Endpoint& minEnd = axes[axis][proxies[proxy].endpoint[axis][0]];
+			Endpoint& maxEnd = axes[axis][proxies[proxy].endpoint[axis][1]];
+			float oldMin = minEnd.value;
+			float oldMax = maxEnd.value;
+			float newMin = box.min()[axis];
+			float newMax = box.max()[axis];
+			minEnd.value = newMin;
+			maxEnd.value = newMax;
+
+			// grow first so a min never has to pass its own max
+			if (newMin < oldMin)
+				sortDown(axis, proxies[proxy].endpoint[axis][0], true);
+			if (newMax > oldMax)
+				sortUp(axis, proxies[proxy].endpoint[axis][1], true);
+			if (newMin > oldMin)
+				sortUp(axis, proxies[proxy].endpoint[axis][0], true);
+			if (newMax < oldMax)
+				sortDown(axis, proxies[proxy].endpoint[axis][1], true);
+		}
+	}
+
+	// the primitive gets its endpoints and pairs at the next flushChanges
+	void SweepAndPrune::onPrimitiveAdded(Primitive* p)
+	{
+		RBXASSERT(p->broadphaseIndexFunc() == -1);
+
+		int proxy = allocateProxy();
+		p->updateFatExtents();
+		proxies[proxy].primitive = p;
+		proxies[proxy].box = p->getFatExtents();
+		proxies[proxy].nextFree = -1;
+		proxies[proxy].pending = true;
+		p->broadphaseIndexFunc() = proxy;
+		numProxies++;
+		onWidthChanged(proxy);
+		addedProxies.append(proxy);
+	}
+
+	// Pairs go now, the endpoints at the next flushChanges. Until then sorts pass them without
+	// reporting, and the proxy stays off the free list.
+	void SweepAndPrune::onPrimitiveRemoved(Primitive* p)
+	{
+		int proxy = p->broadphaseIndexFunc();
+		RBXASSERT(proxy >= 0);
+
+		while (Contact* contact = p->getFirstContact())
+			contactManager->onReleasePair(p, contact->otherPrimitive(p));
+
+		if (proxy == widestProxy)
+			maxWidthDirty = true;
+
+		proxies[proxy].primitive = NULL;
+		removedProxies.append(proxy);
+		numProxies--;
+		p->broadphaseIndexFunc() = -1;
+	}
+
+	void SweepAndPrune::onPrimitiveExtentsChanged(Primitive* p)
+	{
+		if (!p->updateFatExtents())
+			return;
+
+		int proxy = p->broadphaseIndexFunc();
+		if (proxies[proxy].pending)
+		{
+			proxies[proxy].box = p->getFatExtents();
+			onWidthChanged(proxy);
+		}
+		else
+			updateProxy(proxy, p->getFatExtents());
+	}
+
+	void SweepAndPrune::removeDeadEndpoints()
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			G3D::Array<Endpoint>& endpoints = axes[axis];
+			int kept = 0;
+			for (int i = 0; i < endpoints.size(); i++)
+			{
+				Endpoint endpoint = endpoints[i];
+				if (proxies[endpoint.proxy].primitive)
+					setEndpoint(axis, kept++, endpoint);
+			}
+			endpoints.resize(kept, false);
+		}
+	}
+
+	void SweepAndPrune::mergeAddedEndpoints()
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			newEndpoints.fastClear();
+			for (int i = 0; i < addedProxies.size(); i++)
+			{
+				int proxy = addedProxies[i];
+				if (!proxies[proxy].primitive)
+					continue;
+
+				const Extents& box = proxies[proxy].box;
+				Endpoint minEnd = {box.min()[axis], proxy, false};
+				Endpoint maxEnd = {box.max()[axis], proxy, true};
+				newEndpoints.append(minEnd);
+				newEndpoints.append(maxEnd);
+			}
+			std::sort(newEndpoints.begin(), newEndpoints.end(), endpointBelow);
+
+			G3D::Array<Endpoint>& endpoints = axes[axis];
+			mergedEndpoints.resize(endpoints.size() + newEndpoints.size(), false);
+			std::merge(endpoints.begin(), endpoints.end(), newEndpoints.begin(), newEndpoints.end(), mergedEndpoints.begin(), endpointBelow);
+
+			endpoints.resize(mergedEndpoints.size(), false);
+			for (int i = 0; i < mergedEndpoints.size(); i++)
+				setEndpoint(axis, i, mergedEndpoints[i]);
+		}
+	}
+
+	// One pass over the x axis keeping the old and the added boxes open at each endpoint. A min
+	// meets every box open before it: added ones against both lists, old ones against added ones.
+	void SweepAndPrune::sweepAddedPairs()
+	{
+		const G3D::Array<Endpoint>& endpoints = axes[0];
+		active[0].fastClear();
+		active[1].fastClear();
+		for (int i = 0; i < endpoints.size(); i++)
+		{
+			int proxy = endpoints[i].proxy;
+			G3D::Array<int>& open = active[proxies[proxy].pending ? 1 : 0];
+			if (endpoints[i].isMax)
+			{
+				int slot = proxies[proxy].sweepSlot;
+				open[slot] = open.last();
+				proxies[open[slot]].sweepSlot = slot;
+				open.resize(open.size() - 1, false);
+				continue;
+			}
+
+			for (int list = proxies[proxy].pending ? 0 : 1; list < 2; list++)
+			{
+				for (int j = 0; j < active[list].size(); j++)
+					onBeginOverlap(proxy, active[list][j]);
+			}
+			proxies[proxy].sweepSlot = open.size();
+			open.append(proxy);
+		}
+	}
+
+	void SweepAndPrune::flushChanges()
+	{
+		if (removedProxies.size() > 0)
+			removeDeadEndpoints();
+
+		if (addedProxies.size() > 0)
+		{
+			mergeAddedEndpoints();
+			sweepAddedPairs();
+			for (int i = 0; i < addedProxies.size(); i++)
+				proxies[addedProxies[i]].pending = false;
+			addedProxies.fastClear();
+		}
+
+		// only now can a removed proxy be handed out again
+		for (int i = 0; i < removedProxies.size(); i++)
+		{
+			int proxy = removedProxies[i];
+			proxies[proxy].nextFree = freeProxy;
+			freeProxy = proxy;
+		}
+		removedProxies.fastClear();
+	}
+
+	// numSwaps covers one call here - mostly a measure of how coherent the motion was
+	void SweepAndPrune::onAllPrimitivesMoved()
+	{
+		flushChanges();
+		numSwaps = 0;
+		numFatExtentsKept = 0;
+		numFatExtentsShrunk = 0;
+
+		const G3D::Array<Primitive*>& primitives = this->world->getMovingPrimitives();
+		for (int i = 0; i < primitives.size(); i++)
+		{
+			Primitive* primitive = primitives[i];
+			RBXASSERT(primitive->getAssembly()->moving());
+			bool shrunk;
+			if (primitive->updateFatExtents(shrunk))
+			{
+				updateProxy(primitive->broadphaseIndexFunc(), primitive->getFatExtents());
+				if (shrunk)
+					numFatExtentsShrunk++;
+			}
+			else
+				numFatExtentsKept++;
+		}
+	}
+
+	// A box touching extents starts at most maxWidth left of extents' near x side, and no further right
+	// than its far x side - only mins in that range are candidates.
+	void SweepAndPrune::getPrimitivesTouchingExtents(const Extents& extents, const Primitive* ignore, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(answer.size() == 0);
+		flushChanges();
+
+		if (maxWidthDirty)
+		{
+			maxWidth = 0.0f;
+			widestProxy = -1;
+			maxWidthDirty = false;
+			for (int i = 0; i < proxies.size(); i++)
+			{
+				if (proxies[i].primitive)
+					onWidthChanged(i);
+			}
+		}
+
+		const G3D::Array<Endpoint>& endpoints = axes[0];
+		const Endpoint* first = endpoints.getCArray();
+		int begin = static_cast<int>(std::lower_bound(first, first + endpoints.size(), extents.min().x - maxWidth, valueBelow) - first);
+		for (int i = begin; i < endpoints.size() && endpoints[i].value <= extents.max().x; i++)
+		{
+			if (endpoints[i].isMax)
+				continue;
+
+			const Proxy& proxy = proxies[endpoints[i].proxy];
+			if (proxy.primitive != ignore && proxy.primitive->getFastFuzzyExtents().overlapsOrTouches(extents))
+				answer.append(proxy.primitive);
+		}
+	}
+
+	// no hierarchy to cull with - every box in the x slab bounds covers is tested on its own
+	void SweepAndPrune::getPrimitivesInFrustum(const GCamera::Frustum& frustum, const Extents& bounds, G3D::Array<Primitive*>& answer)
+	{
+		getPrimitivesTouchingExtents(bounds, NULL, answer);
+
+		for (int i = answer.size() - 1; i >= 0; i--)
+		{
+			if (cullExtents(answer[i]->getFastFuzzyExtents(), frustum, bounds) == OUTSIDE)
+				answer.fastRemove(i);
+		}
+	}
+
+	void SweepAndPrune::getPrimitivesAlongRay(const G3D::Ray& unitRay, float maxDistance, G3D::Array<Primitive*>& answer)
+	{
+		RBXASSERT(unitRay.direction.isUnit());
+
+		Extents segment = Extents::vv(unitRay.origin, unitRay.origin + unitRay.direction * maxDistance);
+		getPrimitivesTouchingExtents(segment, NULL, answer);
+
+		for (int i = answer.size() - 1; i >= 0; i--)
+		{
+			if (!proxies[answer[i]->broadphaseIndexFunc()].box.overlapsRay(unitRay, maxDistance))
+				answer.fastRemove(i);
+		}
+	}
+}
@@ -6,6 +6,7 @@
 #include "v8world/SpatialHash.h"
 #include "v8world/IWorldStage.h"
 #include "v8world/Assembly.h"
+#include "v8world/Clump.h"
 #include "v8world/SleepStage.h"
 #include "v8world/ClumpStage.h"
 #include "v8world/SimJobStage.h"
@@ -54,17 +55,74 @@ namespace RBX
 
 	int World::getMetric(IWorldStage::MetricType metricType) const
 	{
-		return jointStage->getMetric(metricType);
+		const Kernel* kernel = jointStage->getKernel();
+		const ObjectPool<ContactConnector>& connectorPool = kernel->getContactConnectorPool();
+		const ObjectPool<Point>& pointPool = kernel->getPointPool();
+		const ContactManager::ContactPool& contactPool = contactManager->getContactPool();
+
+		switch (metricType)
+		{
+		case IWorldStage::NUM_POOLED_CONTACT_CONNECTORS:
+			return connectorPool.size();
+		case IWorldStage::NUM_POOLED_POINTS:
+			return pointPool.size();
+		case IWorldStage::NUM_POOLED_CONTACTS:
+			return contactPool.size();
+		case IWorldStage::NUM_POOL_ALLOCATIONS:
+			return connectorPool.getNumAllocations() + pointPool.getNumAllocations() + contactPool.getNumAllocations();
+		case IWorldStage::NUM_POOL_SLABS:
+			return connectorPool.getNumSlabs() + pointPool.getNumSlabs() + contactPool.getNumSlabs();
+		case IWorldStage::NUM_BROADPHASE_SWAPS:
+			return contactManager->getBroadphase().getNumSwaps();
+		case IWorldStage::NUM_BROADPHASE_NEW_PAIRS:
+			return contactManager->getNumNewPairs();
+		case IWorldStage::NUM_BROADPHASE_RELEASED_PAIRS:
+			return contactManager->getNumReleasedPairs();
+		case IWorldStage::NUM_BROADPHASE_FAT_EXTENTS_KEPT:
+			return contactManager->getBroadphase().getNumFatExtentsKept();
+		case IWorldStage::NUM_BROADPHASE_FAT_EXTENTS_SHRUNK:
+			return contactManager->getBroadphase().getNumFatExtentsShrunk();
+		default:
+			return jointStage->getMetric(metricType);
+		}
 	}
 
 	int World::getNumHashNodes() const
 	{
-		return contactManager->getSpatialHash().getNodesOut();
+		return contactManager->getBroadphase().getNodesOut();
 	}
 
 	int World::getMaxBucketSize() const
 	{
-		return contactManager->getSpatialHash().getMaxBucket();
+		return contactManager->getBroadphase().getMaxBucket();
+	}
+
+	void World::onAssemblyStartedMoving(Assembly* a)
+	{
+		typedef std::set<Clump*>::const_iterator ClumpIterator;
+		typedef std::set<Primitive*>::const_iterator PrimIterator;
+
+		for (ClumpIterator clumpIt = a->getClumps().begin(); clumpIt != a->getClumps().end(); clumpIt++)
+		{
+			for (PrimIterator it = (*clumpIt)->clumpPrimBegin(); it != (*clumpIt)->clumpPrimEnd(); it++)
+			{
+				movingPrimitives.fastAppend(*it);
+			}
+		}
+	}
+
+	void World::onAssemblyStoppedMoving(Assembly* a)
+	{
+		typedef std::set<Clump*>::const_iterator ClumpIterator;
+		typedef std::set<Primitive*>::const_iterator PrimIterator;
+
+		for (ClumpIterator clumpIt = a->getClumps().begin(); clumpIt != a->getClumps().end(); clumpIt++)
+		{
+			for (PrimIterator it = (*clumpIt)->clumpPrimBegin(); it != (*clumpIt)->clumpPrimEnd(); it++)
+			{
+				movingPrimitives.fastRemove(*it);
+			}
+		}
 	}
 
 	void World::onPrimitiveContactParametersChanged(Primitive* p)
@@ -109,8 +167,7 @@ namespace RBX
 	{
 		jointStage->onEdgeRemoving(c);
 
-		if (c)
-			delete c;
+		contactManager->deleteContact(c);
 
 		numContacts--;
 	}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "v8kernel/KernelBenchmark.h"
+
+using namespace RBX;
+
+// KernelBenchmark [worldSteps] [substeps]
+// Runs the spring chain at a few lengths under both integrators and prints one row per run.
+// substeps pins the count for every island; 0, the default, leaves it to the kernel.
+int main(int argc, char** argv)
+{
+	int worldSteps = argc > 1 ? atoi(argv[1]) : 1200;
+	int substeps = argc > 2 ? atoi(argv[2]) : 0;
+	if (worldSteps <= 0 || substeps < 0)
+	{
+		fprintf(stderr, "usage: KernelBenchmark [worldSteps] [substeps]\n");
+		return 1;
+	}
+
+	static const int numLinks[] = {2, 8, 20, 50};
+	static const int repeats = 3;
+
+	printf("links  integrator     substeps  energy drift  ms per simulated s\n");
+	for (int i = 0; i < sizeof(numLinks) / sizeof(numLinks[0]); i++)
+	{
+		for (int semiImplicit = 0; semiImplicit < 2; semiImplicit++)
+		{
+			// drift repeats exactly, the time is the best of a few runs
+			KernelBenchmark::Result best;
+			for (int j = 0; j < repeats; j++)
+			{
+				KernelBenchmark::Result result = KernelBenchmark::runSpringChain(semiImplicit != 0, numLinks[i], worldSteps, substeps);
+				if (j == 0 || result.seconds < best.seconds)
+					best = result;
+			}
+
+			printf("%5d  %-13s  %8.2f  %+12.3f  %18.2f\n",
+				numLinks[i],
+				semiImplicit ? "semi-implicit" : "explicit",
+				best.averageSubsteps,
+				best.energyDrift(),
+				best.secondsPerSimulatedSecond() * 1000.0);
+		}
+	}
+
+	return 0;
+}